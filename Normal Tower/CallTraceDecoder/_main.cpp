@@ -0,0 +1,26 @@
+#include <iostream>
+#include <string.h>
+
+#include "../VkE1/CallTrace.h"
+
+// Usage: CallTraceDecoder <trace.bin> <output> [text|csv]
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: CallTraceDecoder <trace.bin> <output> [text|csv]\n";
+		return 1;
+	}
+
+	CallTrace::FORMAT format = CallTrace::FORMAT_TEXT;
+	if (argc > 3 && strcmp(argv[3], "csv") == 0)
+		format = CallTrace::FORMAT_CSV;
+
+	if (CallTrace::Decode(argv[1], argv[2], format) == false)
+	{
+		std::cout << "ERROR: \"" << argv[1] << "\" is not a valid call trace.\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+
+#include <Windows.h>
+#include <DbgHelp.h>
+
+#pragma comment(lib, "Dbghelp.lib")
+
+//#define TEST_ZERO_ALLOCATION // runs TestZeroAllocation in _main.cpp, toggled here so Engine counts frames in release builds too
+
+#if _DEBUG || defined(TEST_ZERO_ALLOCATION)
+#define ALLOCATION_COUNTER
+#endif
+
+#define ALLOCATION_COUNTER_WARMUP_FRAMES 60 // frames that may allocate before the loop counts as steady state
+#define ALLOCATION_COUNTER_SAMPLE_RATE 16 // every Nth steady state allocation records its call site
+#define ALLOCATION_COUNTER_CALL_SITE_CAPACITY 256 // distinct call sites, must be a power of two
+#define ALLOCATION_COUNTER_CALL_SITE_DEPTH 6 // stack frames kept per call site
+
+// Counts every global operator new/delete per frame. Once the loop is past its warmup
+// frames every allocation is a steady state allocation, and a sample of them records
+// its call stack. In test mode EndFrame fails as soon as a steady state frame allocates.
+// The operators are defined by the one translation unit that defines
+// ALLOCATION_COUNTER_OPERATORS before including this header.
+class AllocationCounter
+{
+public:
+	struct Counts
+	{
+		uint64_t allocations;
+		uint64_t frees;
+		uint64_t bytes;	// allocated
+	};
+
+	struct CallSite
+	{
+		uint32_t hash;	// 0 marks an empty slot
+		void* frames[ALLOCATION_COUNTER_CALL_SITE_DEPTH];
+		uint16_t frameCount;
+		uint64_t count;	// sampled allocations
+		uint64_t bytes;
+	};
+
+private:
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> frees{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+	std::atomic<uint64_t> liveBytes{ 0 };
+	std::atomic<uint64_t> sampleIndex{ 0 };
+	std::atomic<bool> steadyState{ false };
+
+	uint64_t frameIndex = 0;
+	uint64_t warmupFrames = ALLOCATION_COUNTER_WARMUP_FRAMES;
+	uint64_t sampleRate = ALLOCATION_COUNTER_SAMPLE_RATE;
+	bool test = false;
+
+	Counts frame = {};
+	Counts steadyStateTotal = {};
+	Counts maxFrame = {};	// steady state only
+	uint64_t allocatingFrames = 0;	// steady state frames with at least one allocation
+	uint64_t firstAllocatingFrame = 0;
+
+	std::atomic_flag callSiteLock = ATOMIC_FLAG_INIT;
+	CallSite callSites[ALLOCATION_COUNTER_CALL_SITE_CAPACITY];
+	uint64_t droppedCallSites = 0;
+
+	static bool& ThreadSampling()
+	{
+		static thread_local bool sampling = false;
+		return sampling;
+	}
+
+	AllocationCounter()
+	{
+		memset(callSites, 0, sizeof(callSites));
+	}
+
+	void Sample(size_t _size)
+	{
+		// CaptureStackBackTrace does not allocate, the guard only protects against whatever the OS might do.
+		if (ThreadSampling())
+			return;
+		ThreadSampling() = true;
+
+		CallSite callSite = {};
+		ULONG hash = 0;
+		callSite.frameCount = CaptureStackBackTrace(2, ALLOCATION_COUNTER_CALL_SITE_DEPTH, callSite.frames, &hash);
+		callSite.hash = hash != 0 ? hash : 1;
+
+		while (callSiteLock.test_and_set(std::memory_order_acquire));
+
+		size_t slot = callSite.hash & (ALLOCATION_COUNTER_CALL_SITE_CAPACITY - 1);
+		size_t probe = 0;
+		for (; probe != ALLOCATION_COUNTER_CALL_SITE_CAPACITY; ++probe)
+		{
+			CallSite& existing = callSites[(slot + probe) & (ALLOCATION_COUNTER_CALL_SITE_CAPACITY - 1)];
+			if (existing.hash == 0)
+				existing = callSite;
+			if (existing.hash == callSite.hash)
+			{
+				++existing.count;
+				existing.bytes += _size;
+				break;
+			}
+		}
+		if (probe == ALLOCATION_COUNTER_CALL_SITE_CAPACITY)
+			++droppedCallSites;
+
+		callSiteLock.clear(std::memory_order_release);
+
+		ThreadSampling() = false;
+	}
+
+public:
+	static AllocationCounter& Get()
+	{
+		static AllocationCounter allocationCounter;
+		return allocationCounter;
+	}
+
+	// Called by the operators, on any thread.
+	void Allocated(void* _memory, size_t _size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(_size, std::memory_order_relaxed);
+		liveBytes.fetch_add(_msize(_memory), std::memory_order_relaxed);
+
+		if (steadyState.load(std::memory_order_relaxed) && sampleIndex.fetch_add(1, std::memory_order_relaxed) % sampleRate == 0)
+			Sample(_size);
+	}
+	void Freed(void* _memory)
+	{
+		frees.fetch_add(1, std::memory_order_relaxed);
+		liveBytes.fetch_sub(_msize(_memory), std::memory_order_relaxed);
+	}
+
+	// Test mode: from _warmupFrames on, any allocating frame fails EndFrame. Every allocation is sampled.
+	void StartTest(uint64_t _warmupFrames)
+	{
+		warmupFrames = _warmupFrames;
+		sampleRate = 1;
+		test = true;
+	}
+
+	// Closes the counts of the frame that just ended. Returns false in test mode if it was a steady state frame that allocated.
+	bool EndFrame()
+	{
+		frame.allocations = allocations.exchange(0, std::memory_order_relaxed);
+		frame.frees = frees.exchange(0, std::memory_order_relaxed);
+		frame.bytes = bytes.exchange(0, std::memory_order_relaxed);
+
+		bool allocated = false;
+		if (steadyState.load(std::memory_order_relaxed))
+		{
+			steadyStateTotal.allocations += frame.allocations;
+			steadyStateTotal.frees += frame.frees;
+			steadyStateTotal.bytes += frame.bytes;
+
+			if (frame.allocations > maxFrame.allocations)
+				maxFrame = frame;
+
+			allocated = frame.allocations != 0;
+			if (allocated && allocatingFrames++ == 0)
+				firstAllocatingFrame = frameIndex;
+		}
+
+		++frameIndex;
+		if (frameIndex == warmupFrames)
+			steadyState.store(true, std::memory_order_relaxed);
+
+		return test == false || allocated == false;
+	}
+
+	Counts GetFrameCounts()
+	{
+		return frame;
+	}
+	uint64_t GetLiveBytes()
+	{
+		return liveBytes.load(std::memory_order_relaxed);
+	}
+	uint64_t GetAllocatingFrames()
+	{
+		return allocatingFrames;
+	}
+	bool Passed()
+	{
+		return allocatingFrames == 0;
+	}
+
+	// Writes the steady state counts and the sampled call sites, resolved with the program database when it is found.
+	bool Report(const char* _filename)
+	{
+		FILE* file = fopen(_filename, "w");
+		if (file == NULL)
+			return false;
+
+		uint64_t steadyStateFrames = frameIndex > warmupFrames ? frameIndex - warmupFrames : 0;
+		fprintf(file, "frames: %llu, warmup: %llu, steady state: %llu, allocating: %llu", (unsigned long long)frameIndex, (unsigned long long)warmupFrames, (unsigned long long)steadyStateFrames, (unsigned long long)allocatingFrames);
+		if (allocatingFrames != 0)
+			fprintf(file, ", first: %llu", (unsigned long long)firstAllocatingFrame);
+		fprintf(file, "\n");
+		fprintf(file, "steady state allocations: %llu, frees: %llu, bytes: %llu\n", (unsigned long long)steadyStateTotal.allocations, (unsigned long long)steadyStateTotal.frees, (unsigned long long)steadyStateTotal.bytes);
+		fprintf(file, "worst frame allocations: %llu, frees: %llu, bytes: %llu\n", (unsigned long long)maxFrame.allocations, (unsigned long long)maxFrame.frees, (unsigned long long)maxFrame.bytes);
+		fprintf(file, "live bytes: %llu\n", (unsigned long long)GetLiveBytes());
+		fprintf(file, "call sites, 1 in %llu allocations sampled, %llu dropped:\n", (unsigned long long)sampleRate, (unsigned long long)droppedCallSites);
+
+		// Allocations made while resolving symbols must not try to take the call site lock again.
+		ThreadSampling() = true;
+
+		HANDLE process = GetCurrentProcess();
+		SymSetOptions(SymGetOptions() | SYMOPT_LOAD_LINES);
+		bool symbols = SymInitialize(process, NULL, TRUE) != FALSE;
+
+		char symbolStorage[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+		SYMBOL_INFO* symbol = (SYMBOL_INFO*)symbolStorage;
+
+		while (callSiteLock.test_and_set(std::memory_order_acquire));
+		for (size_t i = 0; i != ALLOCATION_COUNTER_CALL_SITE_CAPACITY; ++i)
+		{
+			const CallSite& callSite = callSites[i];
+			if (callSite.hash == 0)
+				continue;
+
+			fprintf(file, "%llu allocations, %llu bytes\n", (unsigned long long)callSite.count, (unsigned long long)callSite.bytes);
+			for (uint16_t f = 0; f != callSite.frameCount; ++f)
+			{
+				DWORD64 address = (DWORD64)callSite.frames[f];
+				DWORD64 displacement = 0;
+				DWORD lineDisplacement = 0;
+				IMAGEHLP_LINE64 line = {};
+				line.SizeOfStruct = sizeof(line);
+				memset(symbolStorage, 0, sizeof(symbolStorage));
+				symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+				symbol->MaxNameLen = MAX_SYM_NAME;
+
+				if (symbols && SymFromAddr(process, address, &displacement, symbol) != FALSE)
+				{
+					if (SymGetLineFromAddr64(process, address, &lineDisplacement, &line) != FALSE)
+						fprintf(file, "	%s	%s(%lu)\n", symbol->Name, line.FileName, line.LineNumber);
+					else
+						fprintf(file, "	%s+0x%llx\n", symbol->Name, (unsigned long long)displacement);
+				}
+				else
+				{
+					fprintf(file, "	0x%llx\n", (unsigned long long)address);
+				}
+			}
+		}
+		callSiteLock.clear(std::memory_order_release);
+
+		if (symbols)
+			SymCleanup(process);
+
+		ThreadSampling() = false;
+
+		fclose(file);
+		return true;
+	}
+};
+
+#if defined(ALLOCATION_COUNTER) && defined(ALLOCATION_COUNTER_OPERATORS)
+void* operator new(size_t _size)
+{
+	void* memory = malloc(_size != 0 ? _size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	AllocationCounter::Get().Allocated(memory, _size);
+	return memory;
+}
+void* operator new[](size_t _size)
+{
+	return operator new(_size);
+}
+void* operator new(size_t _size, const std::nothrow_t&) noexcept
+{
+	void* memory = malloc(_size != 0 ? _size : 1);
+	if (memory != nullptr)
+		AllocationCounter::Get().Allocated(memory, _size);
+	return memory;
+}
+void* operator new[](size_t _size, const std::nothrow_t& _nothrow) noexcept
+{
+	return operator new(_size, _nothrow);
+}
+void operator delete(void* _memory) noexcept
+{
+	if (_memory == nullptr)
+		return;
+	AllocationCounter::Get().Freed(_memory);
+	free(_memory);
+}
+void operator delete[](void* _memory) noexcept
+{
+	operator delete(_memory);
+}
+void operator delete(void* _memory, size_t) noexcept
+{
+	operator delete(_memory);
+}
+void operator delete[](void* _memory, size_t) noexcept
+{
+	operator delete(_memory);
+}
+void operator delete(void* _memory, const std::nothrow_t&) noexcept
+{
+	operator delete(_memory);
+}
+void operator delete[](void* _memory, const std::nothrow_t&) noexcept
+{
+	operator delete(_memory);
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef CALL_TRACE_H
+#define CALL_TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#include <Windows.h>
+
+#define CALL_TRACE_MAGIC 0x54434B56 // "VKCT"
+#define CALL_TRACE_VERSION 1
+
+// Fixed-size binary trace of Vulkan calls, recorded by VK_CHECK_RESULT / VK_CHECK_CLEANUP.
+// Records go into a preallocated ring that overwrites the oldest entries, Save writes it out
+// and Decode turns a saved trace back into text or CSV.
+class CallTrace
+{
+public:
+	enum FORMAT
+	{
+		FORMAT_TEXT,
+		FORMAT_CSV,
+	};
+
+	struct Record
+	{
+		uint64_t handle;
+		uint64_t start;	// nanoseconds since Start
+		uint64_t end;	// nanoseconds since Start
+		uint32_t threadId;
+		int32_t result;
+		uint32_t callSite;
+		uint32_t padding;
+	};
+
+	struct CallSite
+	{
+		const char* name;
+		const char* file;
+		uint32_t line;
+	};
+
+private:
+	Record* records = nullptr;
+	uint64_t recordCapacity = 0; // power of two
+	std::atomic<uint64_t> writeIndex{ 0 };
+
+	std::mutex callSitesMutex;
+	std::vector<CallSite> callSites;
+
+	std::chrono::steady_clock::time_point origin;
+
+public:
+	void Start(uint64_t _recordCapacity)
+	{
+		Stop();
+
+		recordCapacity = 1;
+		while (recordCapacity < _recordCapacity)
+			recordCapacity <<= 1;
+
+		records = new Record[recordCapacity];
+		writeIndex = 0;
+		origin = std::chrono::steady_clock::now();
+	}
+	void Stop()
+	{
+		delete[] records;
+		records = nullptr;
+		recordCapacity = 0;
+	}
+
+	uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	// Called once per call site through a function local static.
+	uint32_t RegisterCallSite(const char* _name, const char* _file, uint32_t _line)
+	{
+		std::lock_guard<std::mutex> lock(callSitesMutex);
+		callSites.push_back({ _name, _file, _line });
+		return (uint32_t)callSites.size() - 1;
+	}
+
+	void Add(uint32_t _callSite, int32_t _result, uint64_t _handle, uint64_t _start, uint64_t _end)
+	{
+		if (records == nullptr)
+			return;
+
+		uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+		CallTrace::Record& record = records[index & (recordCapacity - 1)];
+		record.handle = _handle;
+		record.start = _start;
+		record.end = _end;
+		record.threadId = (uint32_t)GetCurrentThreadId();
+		record.result = _result;
+		record.callSite = _callSite;
+		record.padding = 0;
+	}
+
+	template <typename T>
+	static uint64_t Handle(T* _handle)
+	{
+		return (uint64_t)(uintptr_t)_handle;
+	}
+	static uint64_t Handle(const char* _placeholder)
+	{
+		return 0;
+	}
+	template <typename T>
+	static uint64_t Handle(T _handle)
+	{
+		return (uint64_t)_handle;
+	}
+
+	// Layout: magic, version, call site count, record count, call sites (line, name, file), records oldest first.
+	void Save(const char* _filename)
+	{
+		if (records == nullptr)
+			return;
+
+		std::ofstream file(_filename, std::ios::binary);
+
+		uint64_t count = writeIndex.load();
+		uint64_t first = count > recordCapacity ? count - recordCapacity : 0;
+		if (count > recordCapacity)
+			count = recordCapacity;
+
+		std::lock_guard<std::mutex> lock(callSitesMutex);
+
+		uint32_t header[4] = { CALL_TRACE_MAGIC, CALL_TRACE_VERSION, (uint32_t)callSites.size(), (uint32_t)count };
+		file.write((const char*)header, sizeof(header));
+
+		for (size_t i = 0; i != callSites.size(); ++i)
+		{
+			uint32_t nameLength = (uint32_t)strlen(callSites[i].name);
+			uint32_t fileLength = (uint32_t)strlen(callSites[i].file);
+
+			file.write((const char*)&callSites[i].line, sizeof(uint32_t));
+			file.write((const char*)&nameLength, sizeof(uint32_t));
+			file.write(callSites[i].name, nameLength);
+			file.write((const char*)&fileLength, sizeof(uint32_t));
+			file.write(callSites[i].file, fileLength);
+		}
+
+		for (uint64_t i = 0; i != count; ++i)
+			file.write((const char*)&records[(first + i) & (recordCapacity - 1)], sizeof(CallTrace::Record));
+	}
+
+	// Offline decoder, used by the CallTraceDecoder tool.
+	static bool Decode(const char* _inputFilename, const char* _outputFilename, FORMAT _format)
+	{
+		std::ifstream input(_inputFilename, std::ios::binary);
+		if (input.is_open() == false)
+			return false;
+
+		uint32_t header[4];
+		input.read((char*)header, sizeof(header));
+		if (input.good() == false || header[0] != CALL_TRACE_MAGIC || header[1] != CALL_TRACE_VERSION)
+			return false;
+
+		std::vector<std::string> names(header[2]);
+		std::vector<std::string> files(header[2]);
+		std::vector<uint32_t> lines(header[2]);
+		for (uint32_t i = 0; i != header[2]; ++i)
+		{
+			uint32_t length;
+
+			input.read((char*)&lines[i], sizeof(uint32_t));
+			input.read((char*)&length, sizeof(uint32_t));
+			names[i].resize(length);
+			input.read(&names[i][0], length);
+			input.read((char*)&length, sizeof(uint32_t));
+			files[i].resize(length);
+			input.read(&files[i][0], length);
+		}
+
+		std::vector<CallTrace::Record> trace(header[3]);
+		input.read((char*)trace.data(), sizeof(CallTrace::Record) * trace.size());
+		if (input.good() == false)
+			return false;
+
+		FILE* output = fopen(_outputFilename, "w");
+		if (output == NULL)
+			return false;
+
+		if (_format == FORMAT_CSV)
+			fprintf(output, "thread,result,handle,start_ns,end_ns,duration_ns,call,file,line\n");
+
+		for (size_t i = 0; i != trace.size(); ++i)
+		{
+			const CallTrace::Record& record = trace[i];
+			const char* name = record.callSite < names.size() ? names[record.callSite].c_str() : "?";
+			const char* file = record.callSite < files.size() ? files[record.callSite].c_str() : "?";
+			uint32_t line = record.callSite < lines.size() ? lines[record.callSite] : 0;
+
+			if (_format == FORMAT_CSV)
+				fprintf(output, "%u,%d,0x%016llx,%llu,%llu,%llu,%s,%s,%u\n", record.threadId, record.result, (unsigned long long)record.handle, (unsigned long long)record.start, (unsigned long long)record.end, (unsigned long long)(record.end - record.start), name, file, line);
+			else
+				fprintf(output, "Result: %d	Value: 0x%016llx	Time: %.9f	Duration: %.3fus	Thread: %u	Call: %s\n", record.result, (unsigned long long)record.handle, record.start * 0.000000001, (record.end - record.start) * 0.001, record.threadId, name);
+		}
+
+		fclose(output);
+		return true;
+	}
+
+	~CallTrace()
+	{
+		Stop();
+	}
+};
+
+#endif
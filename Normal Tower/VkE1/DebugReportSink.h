@@ -0,0 +1,227 @@
+#ifndef DEBUG_REPORT_SINK_H
+#define DEBUG_REPORT_SINK_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+#include <vulkan\vulkan.h>
+
+#include "Logger.h"
+#include "Timer.h"
+
+#define DEBUG_REPORT_SINK_MESSAGE_CAPACITY 1024 // unique messages, must be a power of two
+#define DEBUG_REPORT_SINK_INTERVAL 1.0 // seconds between summaries of repeated messages
+
+// Sits between VkU::DebugReportCallback and its logger. Messages are hashed on code, layer
+// and text; the first occurrence is logged in full, repeats are only counted and logged
+// as one summary line per message per interval. The counters stay readable so tests can
+// assert on them, e.g. no PERFORMANCE_WARNING during steady state rendering.
+class DebugReportSink
+{
+public:
+	enum CATEGORY
+	{
+		CATEGORY_INFORMATION,
+		CATEGORY_WARNING,
+		CATEGORY_PERFORMANCE_WARNING,
+		CATEGORY_ERROR,
+		CATEGORY_DEBUG,
+		CATEGORY_COUNT,
+	};
+
+	struct Message
+	{
+		uint64_t hash;	// 0 marks an empty slot
+		CATEGORY category;
+		int32_t code;
+		std::string text;
+
+		uint64_t count;			// since Start or ResetCounters
+		uint64_t frameCount;	// in the current frame
+		uint64_t maxFrameCount;	// most in a single frame
+		uint64_t intervalCount;	// not summarized yet
+	};
+
+	struct Counters
+	{
+		uint64_t messages[CATEGORY_COUNT];	// every message, repeats included
+		uint64_t uniqueMessages;
+		uint64_t droppedMessages;	// unique messages that found no free slot
+	};
+
+private:
+	std::mutex mutex;
+	Logger* logger = nullptr;
+
+	Message messages[DEBUG_REPORT_SINK_MESSAGE_CAPACITY];
+	Counters counters = {};
+	long long lastSummary = 0;
+
+	static const char* CategoryName(CATEGORY _category)
+	{
+		static const char* names[CATEGORY_COUNT] = { "	INFORMATION:", "WARNING:", "PERFORMANCE:", "ERROR:", "	DEBUG:" };
+		return names[_category];
+	}
+
+	// FNV-1a
+	static uint64_t Hash(int32_t _code, const char* _layerPrefix, const char* _text)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i != sizeof(_code); ++i)
+			hash = (hash ^ (uint8_t)(_code >> (i * 8))) * 1099511628211ULL;
+		for (const char* c = _layerPrefix; c != nullptr && *c != '\0'; ++c)
+			hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+		for (const char* c = _text; c != nullptr && *c != '\0'; ++c)
+			hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+
+		return hash != 0 ? hash : 1;
+	}
+
+	void Summarize()
+	{
+		for (size_t i = 0; i != DEBUG_REPORT_SINK_MESSAGE_CAPACITY; ++i)
+		{
+			Message& message = messages[i];
+			if (message.hash == 0 || message.intervalCount == 0)
+				continue;
+
+			if (logger != nullptr)
+				*logger << CategoryName(message.category) << "(repeated " << message.intervalCount << " times, " << message.count << " total, at most " << message.maxFrameCount << " per frame) " << message.text << '\n';
+			message.intervalCount = 0;
+		}
+	}
+
+public:
+	void Start(Logger* _logger)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		logger = _logger;
+		for (size_t i = 0; i != DEBUG_REPORT_SINK_MESSAGE_CAPACITY; ++i)
+			messages[i] = {};
+		counters = {};
+		lastSummary = Timer::GetTimestamp();
+	}
+
+	// Called from the debug report callback, possibly on several threads.
+	void Add(VkDebugReportFlagsEXT _flags, int32_t _code, const char* _layerPrefix, const char* _text)
+	{
+		CATEGORY category = CATEGORY_DEBUG;
+		if (_flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT)
+			category = CATEGORY_INFORMATION;
+		if (_flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
+			category = CATEGORY_WARNING;
+		if (_flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
+			category = CATEGORY_PERFORMANCE_WARNING;
+		if (_flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+			category = CATEGORY_ERROR;
+
+		uint64_t hash = Hash(_code, _layerPrefix, _text);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		++counters.messages[category];
+
+		size_t slot = hash & (DEBUG_REPORT_SINK_MESSAGE_CAPACITY - 1);
+		for (size_t probe = 0; probe != DEBUG_REPORT_SINK_MESSAGE_CAPACITY; ++probe)
+		{
+			Message& message = messages[(slot + probe) & (DEBUG_REPORT_SINK_MESSAGE_CAPACITY - 1)];
+
+			if (message.hash == hash)
+			{
+				++message.count;
+				++message.frameCount;
+				++message.intervalCount;
+				return;
+			}
+			if (message.hash == 0)
+			{
+				message.hash = hash;
+				message.category = category;
+				message.code = _code;
+				message.text = _text;
+				message.count = 1;
+				message.frameCount = 1;
+				message.maxFrameCount = 0;
+				message.intervalCount = 0;
+				++counters.uniqueMessages;
+
+				if (logger != nullptr)
+					*logger << CategoryName(category) << _text << '\n';
+				return;
+			}
+		}
+
+		++counters.droppedMessages;
+		if (logger != nullptr)
+			*logger << CategoryName(category) << _text << '\n';
+	}
+
+	// Closes the per frame counts and logs the summary lines once the interval has passed.
+	void EndFrame()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (size_t i = 0; i != DEBUG_REPORT_SINK_MESSAGE_CAPACITY; ++i)
+		{
+			Message& message = messages[i];
+			if (message.frameCount > message.maxFrameCount)
+				message.maxFrameCount = message.frameCount;
+			message.frameCount = 0;
+		}
+
+		long long now = Timer::GetTimestamp();
+		if ((now - lastSummary) * 0.000000001 >= DEBUG_REPORT_SINK_INTERVAL)
+		{
+			lastSummary = now;
+			Summarize();
+		}
+	}
+	// Logs whatever has not been summarized yet.
+	void Flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Summarize();
+	}
+
+	Counters GetCounters()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return counters;
+	}
+	uint64_t GetCount(CATEGORY _category)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return counters.messages[_category];
+	}
+	// Copies the unique messages of one category, e.g. to report which performance warnings fired.
+	size_t GetMessages(CATEGORY _category, Message* _messages, size_t _capacity)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		size_t count = 0;
+		for (size_t i = 0; i != DEBUG_REPORT_SINK_MESSAGE_CAPACITY && count != _capacity; ++i)
+		{
+			if (messages[i].hash != 0 && messages[i].category == _category)
+				_messages[count++] = messages[i];
+		}
+		return count;
+	}
+	// Zeroes the counters but keeps the known messages, so they are not logged in full again.
+	void ResetCounters()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		counters = {};
+		for (size_t i = 0; i != DEBUG_REPORT_SINK_MESSAGE_CAPACITY; ++i)
+		{
+			messages[i].count = 0;
+			messages[i].frameCount = 0;
+			messages[i].maxFrameCount = 0;
+			messages[i].intervalCount = 0;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef DIRTY_ARRAY_H
+#define DIRTY_ARRAY_H
+
+#include <stdint.h>
+#include <intrin.h>
+#include <cstring>
+#include <vector>
+
+// Host side array mirrored into one GPU copy per slot (frame in flight). Modify marks
+// elements dirty in every slot, Upload writes the dirty runs of one slot and clears
+// them, so a frame costs O(changed) instead of O(capacity). A bit per element and
+// slot, plus the span of words each slot has dirty, keeps clean words out of the scan.
+template<typename T>
+class DirtyArray
+{
+	std::vector<T> elements;
+
+	std::vector<uint64_t> dirtyBits;	// slotCount rows of wordCount words
+	std::vector<size_t> firstDirtyWords;	// per slot, firstDirtyWord == endDirtyWord when clean
+	std::vector<size_t> endDirtyWords;
+	size_t wordCount = 0;
+
+	static uint32_t LowestBit(uint64_t _mask)
+	{
+		unsigned long index;
+		_BitScanForward64(&index, _mask);
+		return (uint32_t)index;
+	}
+
+public:
+	// Every element is dirty in every slot afterwards.
+	void Resize(size_t _count, uint32_t _slotCount)
+	{
+		elements.resize(_count);
+
+		wordCount = (_count + 63) / 64;
+		dirtyBits.assign(wordCount * _slotCount, 0);
+		firstDirtyWords.assign(_slotCount, 0);
+		endDirtyWords.assign(_slotCount, 0);
+
+		MarkDirty(0, _count);
+	}
+	size_t Size() const
+	{
+		return elements.size();
+	}
+	const T* Data() const
+	{
+		return elements.data();
+	}
+	const T& operator[](size_t _index) const
+	{
+		return elements[_index];
+	}
+
+	void MarkDirty(size_t _first, size_t _count)
+	{
+		if (_count == 0)
+			return;
+
+		size_t firstWord = _first / 64;
+		size_t endWord = (_first + _count + 63) / 64;
+
+		for (size_t slot = 0; slot != firstDirtyWords.size(); ++slot)
+		{
+			uint64_t* row = &dirtyBits[slot * wordCount];
+			for (size_t i = _first; i != _first + _count;)
+			{
+				uint32_t bit = i % 64;
+				size_t bitCount = 64 - bit < _first + _count - i ? 64 - bit : _first + _count - i;
+				row[i / 64] |= (bitCount == 64 ? ~0ull : ((1ull << bitCount) - 1)) << bit;
+				i += bitCount;
+			}
+
+			if (firstDirtyWords[slot] == endDirtyWords[slot])
+			{
+				firstDirtyWords[slot] = firstWord;
+				endDirtyWords[slot] = endWord;
+			}
+			else
+			{
+				if (firstWord < firstDirtyWords[slot])
+					firstDirtyWords[slot] = firstWord;
+				if (endWord > endDirtyWords[slot])
+					endDirtyWords[slot] = endWord;
+			}
+		}
+	}
+	// Write access, marks the element dirty.
+	T& Modify(size_t _index)
+	{
+		MarkDirty(_index, 1);
+		return elements[_index];
+	}
+	T* Modify(size_t _first, size_t _count)
+	{
+		MarkDirty(_first, _count);
+		return elements.data() + _first;
+	}
+
+	// Calls _function(first, count) for every run of elements dirty in _slot and clears them. Returns the run count.
+	template<typename Function>
+	uint32_t ForEachDirtyRange(uint32_t _slot, Function _function)
+	{
+		uint64_t* row = &dirtyBits[_slot * wordCount];
+		uint32_t rangeCount = 0;
+		size_t runFirst = 0;
+		size_t runCount = 0;
+
+		for (size_t w = firstDirtyWords[_slot]; w != endDirtyWords[_slot]; ++w)
+		{
+			uint64_t bits = row[w];
+			row[w] = 0;
+
+			uint32_t b = 0;
+			while (b != 64)
+			{
+				uint64_t rest = bits >> b;
+				uint32_t clean = rest == 0 ? 64 - b : LowestBit(rest);
+				if (clean != 0)
+				{
+					if (runCount != 0)
+					{
+						_function(runFirst, runCount);
+						++rangeCount;
+						runCount = 0;
+					}
+					b += clean;
+					continue;
+				}
+
+				uint32_t dirty = ~rest == 0 ? 64 - b : LowestBit(~rest);
+				if (runCount == 0)
+					runFirst = w * 64 + b;
+				runCount += dirty;
+				b += dirty;
+			}
+		}
+		if (runCount != 0)
+		{
+			_function(runFirst, runCount);
+			++rangeCount;
+		}
+
+		firstDirtyWords[_slot] = 0;
+		endDirtyWords[_slot] = 0;
+
+		return rangeCount;
+	}
+	// Copies the dirty runs of _slot into its mirror, _destination holds element 0.
+	uint32_t Upload(uint32_t _slot, void* _destination)
+	{
+		uint8_t* destination = (uint8_t*)_destination;
+		return ForEachDirtyRange(_slot, [&](size_t _first, size_t _count) { memcpy(destination + sizeof(T) * _first, elements.data() + _first, sizeof(T) * _count); });
+	}
+};
+
+#endif
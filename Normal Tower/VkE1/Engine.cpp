@@ -6,11 +6,15 @@ Timer Engine::timer;
 double Engine::deltaTime;
 Camera Engine::camera;
 
-void Engine::Init()
+void Engine::Init(bool _headless)
 {
+	startupStart = Profiler::Get().Now();
+	PROFILE_ZONE("Engine::Init");
+
 	Camera::globalUp = glm::vec3(0.0f, 1.0f, 0.0f);
 
 	timer.SetResolution(Timer::RESOLUTION_NANOSECONDS);
+	timer.SetMode(Timer::MODE_INTEGER);
 	timer.Play();
 
 	input.activeKeys = { Input::INPUT_KEYS::KEY_ESC,
@@ -22,7 +26,7 @@ void Engine::Init()
 	input.Update();
 	input.Update();
 
-	renderer.Init();
+	renderer.Init(_headless);
 	renderer.Load(
 	{
 		Renderer::ShaderProperties::GetShaderProperties("Shaders/vert.spv", VK_SHADER_STAGE_VERTEX_BIT, "main"),
@@ -42,10 +46,14 @@ void Engine::Init()
 
 void Engine::Input()
 {
+	PROFILE_ZONE("Engine::Input");
+
 	input.Update();
 }
 void Engine::Update()
 {
+	PROFILE_ZONE("Engine::Update");
+
 	glm::vec3 translation;
 
 	if (input.CheckKeyDown(Input::INPUT_KEYS::KEY_W))
@@ -95,13 +103,16 @@ void Engine::Update()
 }
 void Engine::Render()
 {
+	PROFILE_ZONE("Engine::Render");
+
 	renderer.Render();
 }
 
-void Engine::Loop()
+void Engine::Loop(uint64_t _frameCount)
 {
 	double previousTime = timer.GetTime();
 	double currentTime;
+	uint64_t frame = 0;
 
 	while (!done)
 	{
@@ -115,10 +126,35 @@ void Engine::Loop()
 		Input();
 		Update();
 		Render();
+
+		PROFILE_FRAME();
+
+		if (frame == 0)
+		{
+			uint64_t now = Profiler::Get().Now();
+			startupTime = (now - startupStart) * 0.000000001;
+			Profiler::Get().SaveTimeline("_StartupTimeline.txt", startupStart, now);
+		}
+
+#ifdef ALLOCATION_COUNTER
+		if (AllocationCounter::Get().EndFrame() == false)
+			done = true;
+#endif
+
+		++frame;
+		if (_frameCount != 0 && frame == _frameCount)
+			done = true;
 	}
 }
 
 void Engine::ShutDown()
 {
 	renderer.ShutDown();
+
+#ifdef PROFILER
+	Profiler::Get().Save("_Profile.json");
+#endif
+#ifdef ALLOCATION_COUNTER
+	AllocationCounter::Get().Report("_AllocationReport.txt");
+#endif
 }
@@ -2,6 +2,7 @@
 #define ENGINE_H
 
 #include "Timer.h"
+#include "AllocationCounter.h"
 
 #include "Input.h"
 #include "Renderer.h"
@@ -79,18 +80,22 @@ public:
 
 	bool done = false;
 
+	uint64_t startupStart = 0;	// profiler time Init was called
+	double startupTime = 0.0;	// seconds from Init to the end of the first frame
+
 	Input input;
 	Renderer renderer;
 
 	static Camera camera;
 
-	void Init();
+	void Init(bool _headless = false);
 
 	void Input();
 	void Update();
 	void Render();
 
-	void Loop();
+	// Runs until escape is pressed, or for _frameCount frames when it is not 0.
+	void Loop(uint64_t _frameCount = 0);
 
 	void ShutDown();
 };
@@ -0,0 +1,133 @@
+#ifndef FRAME_STATISTICS_H
+#define FRAME_STATISTICS_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define FRAME_STATISTICS_HISTORY 1024 // frames kept for the rolling percentiles
+#define FRAME_STATISTICS_BUCKET_COUNT 100 // histogram buckets, the last one takes everything above
+#define FRAME_STATISTICS_BUCKET_WIDTH 0.0005 // seconds
+#define FRAME_STATISTICS_TITLE_INTERVAL 0.5 // seconds between window title updates
+
+// Frame times over a fixed window of recent frames plus a histogram of every frame since
+// startup. Adding a frame only writes into preallocated arrays, the percentiles are
+// computed when asked for.
+class FrameStatistics
+{
+public:
+	struct Summary
+	{
+		uint64_t frameCount;	// frames in the window
+		double average;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+private:
+	double history[FRAME_STATISTICS_HISTORY];
+	double sorted[FRAME_STATISTICS_HISTORY];
+	uint64_t frameCount = 0;
+
+	uint64_t histogram[FRAME_STATISTICS_BUCKET_COUNT] = {};
+	double totalTime = 0.0;
+	double maxTime = 0.0;
+
+	// _first is the index of a previous, lower percentile, everything above it is already larger
+	static double Percentile(double* _sorted, size_t _first, size_t _count, double _percentile, size_t& _index)
+	{
+		_index = (size_t)(_percentile * (_count - 1) + 0.5);
+		std::nth_element(_sorted + _first, _sorted + _index, _sorted + _count);
+		return _sorted[_index];
+	}
+
+public:
+	void Add(double _frameTime)
+	{
+		history[frameCount % FRAME_STATISTICS_HISTORY] = _frameTime;
+		++frameCount;
+
+		size_t bucket = (size_t)(_frameTime / FRAME_STATISTICS_BUCKET_WIDTH);
+		if (bucket >= FRAME_STATISTICS_BUCKET_COUNT)
+			bucket = FRAME_STATISTICS_BUCKET_COUNT - 1;
+		++histogram[bucket];
+
+		totalTime += _frameTime;
+		if (_frameTime > maxTime)
+			maxTime = _frameTime;
+	}
+
+	// Rolling values over the last FRAME_STATISTICS_HISTORY frames.
+	Summary GetSummary()
+	{
+		Summary summary = {};
+
+		size_t count = frameCount < FRAME_STATISTICS_HISTORY ? (size_t)frameCount : FRAME_STATISTICS_HISTORY;
+		if (count == 0)
+			return summary;
+
+		memcpy(sorted, history, sizeof(double) * count);
+
+		summary.frameCount = count;
+		for (size_t i = 0; i != count; ++i)
+		{
+			summary.average += sorted[i];
+			if (sorted[i] > summary.max)
+				summary.max = sorted[i];
+		}
+		summary.average /= count;
+
+		size_t index = 0;
+		summary.p50 = Percentile(sorted, index, count, 0.50, index);
+		summary.p95 = Percentile(sorted, index, count, 0.95, index);
+		summary.p99 = Percentile(sorted, index, count, 0.99, index);
+
+		return summary;
+	}
+	uint64_t GetFrameCount()
+	{
+		return frameCount;
+	}
+
+	// Writes the frame times still in the window as CSV and a summary with the whole histogram as JSON.
+	bool Save(const char* _csvFilename, const char* _jsonFilename)
+	{
+		FILE* file = fopen(_csvFilename, "w");
+		if (file == NULL)
+			return false;
+
+		size_t count = frameCount < FRAME_STATISTICS_HISTORY ? (size_t)frameCount : FRAME_STATISTICS_HISTORY;
+		fprintf(file, "frame,frame_time_ms\n");
+		for (size_t i = 0; i != count; ++i)
+		{
+			uint64_t frame = frameCount - count + i;
+			fprintf(file, "%llu,%.4f\n", (unsigned long long)frame, history[frame % FRAME_STATISTICS_HISTORY] * 1000.0);
+		}
+		fclose(file);
+
+		file = fopen(_jsonFilename, "w");
+		if (file == NULL)
+			return false;
+
+		Summary summary = GetSummary();
+		fprintf(file, "{\n");
+		fprintf(file, "\t\"frames\": %llu,\n", (unsigned long long)frameCount);
+		fprintf(file, "\t\"average_ms\": %.4f,\n", frameCount != 0 ? totalTime / frameCount * 1000.0 : 0.0);
+		fprintf(file, "\t\"max_ms\": %.4f,\n", maxTime * 1000.0);
+		fprintf(file, "\t\"window\": { \"frames\": %llu, \"average_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f },\n", (unsigned long long)summary.frameCount, summary.average * 1000.0, summary.p50 * 1000.0, summary.p95 * 1000.0, summary.p99 * 1000.0, summary.max * 1000.0);
+		fprintf(file, "\t\"histogram_bucket_ms\": %.4f,\n", FRAME_STATISTICS_BUCKET_WIDTH * 1000.0);
+		fprintf(file, "\t\"histogram\": [");
+		for (size_t i = 0; i != FRAME_STATISTICS_BUCKET_COUNT; ++i)
+			fprintf(file, i == 0 ? "%llu" : ", %llu", (unsigned long long)histogram[i]);
+		fprintf(file, "]\n");
+		fprintf(file, "}\n");
+		fclose(file);
+
+		return true;
+	}
+};
+
+#endif
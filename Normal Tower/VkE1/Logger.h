@@ -3,42 +3,481 @@
 
 #include <fstream>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <type_traits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <Windows.h>
 
 #define COUT_LOG
 #define SAVE_LOG_ALWAYS
 
+#define LOGGER_RING_SIZE 65536 // bytes, must be a power of two
+#define LOGGER_RING_COUNT 16 // producer threads per async logger
+#define LOGGER_MAX_ASYNC_LOGGERS 16
+
 #ifdef COUT_LOG
 #include <iostream>
 #endif
 
 class Logger
 {
+public:
+	enum MODE
+	{
+		MODE_SYNC,	// writes and reopens the file on every token
+		MODE_ASYNC,	// formats into per thread rings drained by a writer thread
+	};
+
+private:
+	// single producer (owner thread) / single consumer (writer thread)
+	struct Ring
+	{
+		std::atomic<std::thread::id> owner;
+		std::atomic<size_t> head;
+		std::atomic<size_t> tail;
+		char data[LOGGER_RING_SIZE];
+	};
+
 	std::ofstream file;
 	std::string name;
 
+	MODE mode = MODE_SYNC;
+	Ring* rings = nullptr;
+	std::thread writer;
+	std::atomic<bool> running{ false };
+	std::atomic<bool> draining{ false };
+	std::vector<char> batch;
+
+	// The rings a thread claimed, handed back when it exits. Worker pools come and go with every Engine.
+	struct ThreadRings
+	{
+		Logger* loggers[LOGGER_MAX_ASYNC_LOGGERS] = {};
+		Ring* rings[LOGGER_MAX_ASYNC_LOGGERS] = {};
+
+		~ThreadRings()
+		{
+			for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+			{
+				if (loggers[i] != nullptr)
+					ReleaseRing(loggers[i], rings[i]);
+			}
+		}
+	};
+
+	static std::atomic<Logger*>* AsyncLoggers()
+	{
+		static std::atomic<Logger*> asyncLoggers[LOGGER_MAX_ASYNC_LOGGERS] = {};
+		return asyncLoggers;
+	}
+	// Held while a logger is unregistered and while an exiting thread looks its logger up
+	static std::atomic_flag& RegistryLock()
+	{
+		static std::atomic_flag registryLock = ATOMIC_FLAG_INIT;
+		return registryLock;
+	}
+	static void LockRegistry()
+	{
+		while (RegistryLock().test_and_set(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+	static ThreadRings& GetThreadRings()
+	{
+		static thread_local ThreadRings threadRings;
+		return threadRings;
+	}
+	static void CrashSignalHandler(int _signal)
+	{
+		FlushAllOnCrash();
+		std::signal(_signal, SIG_DFL);
+		std::raise(_signal);
+	}
+	static LONG WINAPI CrashExceptionFilter(EXCEPTION_POINTERS* _exceptionPointers)
+	{
+		FlushAllOnCrash();
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+	static void InstallCrashHandlers()
+	{
+		static std::atomic<bool> installed{ false };
+		if (installed.exchange(true) == true)
+			return;
+
+		std::atexit(FlushAll);
+		std::signal(SIGABRT, CrashSignalHandler);
+		std::signal(SIGSEGV, CrashSignalHandler);
+		SetUnhandledExceptionFilter(CrashExceptionFilter);
+	}
+	void Register()
+	{
+		for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+		{
+			Logger* expected = nullptr;
+			if (AsyncLoggers()[i].compare_exchange_strong(expected, this))
+				return;
+		}
+	}
+	void Unregister()
+	{
+		LockRegistry();
+		for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+		{
+			Logger* expected = this;
+			if (AsyncLoggers()[i].compare_exchange_strong(expected, nullptr))
+				break;
+		}
+		RegistryLock().clear(std::memory_order_release);
+	}
+	static bool IsRegistered(Logger* _logger)
+	{
+		for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+		{
+			if (AsyncLoggers()[i].load() == _logger)
+				return true;
+		}
+		return false;
+	}
+	// Called when the thread that claimed _ring exits. Writes out what is left in it, partial line
+	// included, and frees it for the next thread. StopAsync unregisters before it deletes the rings,
+	// so a logger still registered under the registry lock keeps its rings until draining is released.
+	static void ReleaseRing(Logger* _logger, Ring* _ring)
+	{
+		LockRegistry();
+		bool registered = IsRegistered(_logger);
+		if (registered)
+			_logger->LockDraining();
+		RegistryLock().clear(std::memory_order_release);
+		if (registered == false)
+			return;
+
+		// a restarted logger has new rings, the old one is gone with its content
+		if (_logger->rings != nullptr && _ring >= _logger->rings && _ring < _logger->rings + LOGGER_RING_COUNT && _ring->owner.load(std::memory_order_relaxed) == std::this_thread::get_id())
+		{
+			_logger->batch.clear();
+			_logger->CollectRing(*_ring, true);
+			_logger->WriteBatch();
+			_ring->owner.store(std::thread::id(), std::memory_order_release);
+		}
+		_logger->draining = false;
+	}
+
+	void StartAsync()
+	{
+		rings = new Ring[LOGGER_RING_COUNT];
+		for (size_t i = 0; i != LOGGER_RING_COUNT; ++i)
+		{
+			rings[i].owner.store(std::thread::id());
+			rings[i].head.store(0);
+			rings[i].tail.store(0);
+		}
+		batch.reserve(LOGGER_RING_SIZE);
+
+		running = true;
+		writer = std::thread(&Logger::WriterLoop, this);
+
+		Register();
+		InstallCrashHandlers();
+	}
+	void StopAsync()
+	{
+		Unregister();
+
+		running = false;
+		if (writer.joinable())
+			writer.join();
+		Drain(true);
+
+		delete[] rings;
+		rings = nullptr;
+	}
+	void WriterLoop()
+	{
+		while (running)
+		{
+			Drain(false);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// draining guards the file and the consumer side of the rings
+	void LockDraining()
+	{
+		bool expected = false;
+		while (!draining.compare_exchange_weak(expected, true))
+		{
+			expected = false;
+			std::this_thread::yield();
+		}
+	}
+	// A single attempt, the crash handlers must not wait on a holder that may be the crashed thread.
+	bool TryLockDraining()
+	{
+		bool expected = false;
+		return draining.compare_exchange_strong(expected, true);
+	}
+
+	void Drain(bool _all)
+	{
+		LockDraining();
+		DrainLocked(_all);
+		draining = false;
+	}
+	// Consumer side. Collects every ring into one batch and issues a single write.
+	// Partial lines are left in the ring so lines from different threads never interleave.
+	void DrainLocked(bool _all)
+	{
+		batch.clear();
+		for (size_t r = 0; r != LOGGER_RING_COUNT; ++r)
+		{
+			if (rings[r].owner.load(std::memory_order_acquire) != std::thread::id())
+				CollectRing(rings[r], _all);
+		}
+		WriteBatch();
+	}
+	void CollectRing(Ring& _ring, bool _all)
+	{
+		size_t tail = _ring.tail.load(std::memory_order_relaxed);
+		size_t head = _ring.head.load(std::memory_order_acquire);
+		size_t end = head;
+
+		if (_all == false)
+		{
+			while (end != tail && _ring.data[(end - 1) & (LOGGER_RING_SIZE - 1)] != '\n')
+				--end;
+
+			// a full ring without a single line break would never drain otherwise
+			if (end == tail && head - tail == LOGGER_RING_SIZE)
+				end = head;
+		}
+
+		for (size_t i = tail; i != end;)
+		{
+			size_t offset = i & (LOGGER_RING_SIZE - 1);
+			size_t count = end - i;
+			if (count > LOGGER_RING_SIZE - offset)
+				count = LOGGER_RING_SIZE - offset;
+
+			batch.insert(batch.end(), &_ring.data[offset], &_ring.data[offset] + count);
+			i += count;
+		}
+
+		_ring.tail.store(end, std::memory_order_release);
+	}
+	void WriteBatch()
+	{
+		if (batch.empty() == false)
+		{
+			file.write(batch.data(), batch.size());
+			file.flush();
+#ifdef COUT_LOG
+			std::cout.write(batch.data(), batch.size());
+#endif
+		}
+	}
+
+	Ring* GetThreadRing()
+	{
+		std::thread::id id = std::this_thread::get_id();
+
+		for (size_t i = 0; i != LOGGER_RING_COUNT; ++i)
+		{
+			if (rings[i].owner.load(std::memory_order_relaxed) == id)
+				return &rings[i];
+		}
+		for (size_t i = 0; i != LOGGER_RING_COUNT; ++i)
+		{
+			std::thread::id expected;
+			if (rings[i].owner.compare_exchange_strong(expected, id))
+			{
+				// remembered so the ring is released when this thread exits, replaces a ring of this logger from before a restart
+				ThreadRings& threadRings = GetThreadRings();
+				size_t slot = LOGGER_MAX_ASYNC_LOGGERS;
+				for (size_t l = 0; l != LOGGER_MAX_ASYNC_LOGGERS; ++l)
+				{
+					if (threadRings.loggers[l] == this || (threadRings.loggers[l] == nullptr && slot == LOGGER_MAX_ASYNC_LOGGERS))
+						slot = l;
+				}
+				if (slot != LOGGER_MAX_ASYNC_LOGGERS)
+				{
+					threadRings.loggers[slot] = this;
+					threadRings.rings[slot] = &rings[i];
+				}
+				return &rings[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Producer side. Never locks, only yields while the writer catches up on a full ring.
+	void Write(const char* _data, size_t _size)
+	{
+		Ring* ring = GetThreadRing();
+
+		if (ring == nullptr)
+		{
+			// out of rings, fall back to a direct write
+			LockDraining();
+			file.write(_data, _size);
+#ifdef COUT_LOG
+			std::cout.write(_data, _size);
+#endif
+			draining = false;
+			return;
+		}
+
+		size_t head = ring->head.load(std::memory_order_relaxed);
+		while (_size != 0)
+		{
+			size_t space = LOGGER_RING_SIZE - (head - ring->tail.load(std::memory_order_acquire));
+			if (space == 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			size_t offset = head & (LOGGER_RING_SIZE - 1);
+			size_t count = _size < space ? _size : space;
+			if (count > LOGGER_RING_SIZE - offset)
+				count = LOGGER_RING_SIZE - offset;
+
+			memcpy(&ring->data[offset], _data, count);
+			head += count;
+			ring->head.store(head, std::memory_order_release);
+
+			_data += count;
+			_size -= count;
+		}
+	}
+
+	void Append(const char* _data)
+	{
+		Write(_data, strlen(_data));
+	}
+	void Append(const std::string& _data)
+	{
+		Write(_data.data(), _data.size());
+	}
+	void Append(char _data)
+	{
+		Write(&_data, 1);
+	}
+	void Append(bool _data)
+	{
+		Write(_data ? "1" : "0", 1);
+	}
+	void Append(double _data)
+	{
+		char text[32];
+		int size = snprintf(text, sizeof(text), "%g", _data);
+		Write(text, (size_t)size);
+	}
+	void Append(const void* _data)
+	{
+		char text[32];
+		int size = snprintf(text, sizeof(text), "%p", _data);
+		Write(text, (size_t)size);
+	}
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type Append(const T& _data)
+	{
+		// like the ostream of the sync path, signed and unsigned char are characters
+		if (std::is_integral<T>::value && sizeof(T) == 1)
+		{
+			char character = (char)_data;
+			Write(&character, 1);
+			return;
+		}
+
+		char text[32];
+		int size;
+		if (std::is_unsigned<T>::value)
+			size = snprintf(text, sizeof(text), "%llu", (unsigned long long)_data);
+		else
+			size = snprintf(text, sizeof(text), "%lld", (long long)_data);
+		Write(text, (size_t)size);
+	}
+
 public:
-	void Start(const char* _logFilename)
+	void Start(const char* _logFilename, MODE _mode = MODE_SYNC)
 	{
-		if (file.is_open())
-			file.close();
+		Close();
 		file = std::ofstream(_logFilename);
 		name = _logFilename;
+
+		mode = _mode;
+		if (mode == MODE_ASYNC)
+			StartAsync();
 	}
 	void Set(const char* _logFilename)
 	{
+		// the writer thread may be writing to the old file
+		bool async = mode == MODE_ASYNC && rings != nullptr;
+		if (async)
+			LockDraining();
+
 		if (file.is_open())
 			file.close();
 		file = std::ofstream(_logFilename, std::fstream::app);
 		name = _logFilename;
+
+		if (async)
+			draining = false;
 	}
 	void Close()
 	{
+		if (mode == MODE_ASYNC && rings != nullptr)
+			StopAsync();
 		file.close();
 	}
+	void Flush()
+	{
+		if (mode == MODE_ASYNC && rings != nullptr)
+			Drain(true);
+		else
+			file.flush();
+	}
+
+	// Flushes every async logger, called at exit.
+	static void FlushAll()
+	{
+		for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+		{
+			Logger* logger = AsyncLoggers()[i].load();
+			if (logger != nullptr)
+				logger->Flush();
+		}
+	}
+	// Flushes every async logger nobody is draining right now, called from the crash handlers. Never waits, so a
+	// crash while the writer thread or the crashing thread holds a logger loses that logger's tail instead of hanging.
+	static void FlushAllOnCrash()
+	{
+		for (size_t i = 0; i != LOGGER_MAX_ASYNC_LOGGERS; ++i)
+		{
+			Logger* logger = AsyncLoggers()[i].load();
+			if (logger == nullptr || logger->rings == nullptr || logger->TryLockDraining() == false)
+				continue;
+
+			logger->DrainLocked(true);
+			logger->draining = false;
+		}
+	}
 
 	template <typename T>
 	Logger &operator<<(const T &_data)
 	{
+		if (mode == MODE_ASYNC && rings != nullptr)
+		{
+			Append(_data);
+			return *this;
+		}
+
 		file << _data;
 
 #ifdef SAVE_LOG_ALWAYS
@@ -54,7 +493,7 @@ public:
 
 	~Logger()
 	{
-		file.close();
+		Close();
 	}
 };
 
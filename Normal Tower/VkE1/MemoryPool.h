@@ -0,0 +1,509 @@
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <stdint.h>
+#include <intrin.h>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <vulkan\vulkan.h>
+
+#include "MemoryTracker.h"
+
+#define MEMORY_POOL_BLOCK_SIZE (64ull << 20) // bytes per block, larger requests get a dedicated block
+#define MEMORY_POOL_MIN_ALIGNMENT 256 // every offset and size is a multiple of this, must be a power of two
+#define MEMORY_POOL_SL_LOG2 4 // second level lists per power of two
+#define MEMORY_POOL_SL_COUNT (1 << MEMORY_POOL_SL_LOG2)
+#define MEMORY_POOL_FL_COUNT 64
+#define MEMORY_POOL_NONE 0xFFFFFFFF
+
+// Sub-allocates device memory out of large blocks with a two level segregated fit (TLSF)
+// allocator per block. Blocks are kept per memory type, MemoryTracker category and
+// linear or optimal tiling, so a block never mixes linear and optimal resources and
+// bufferImageGranularity cannot be violated. Host visible blocks stay mapped.
+class MemoryPool
+{
+public:
+	struct Allocation
+	{
+		VkDeviceMemory handle;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint8_t* mapped;	// nullptr unless the memory type is host visible
+		uint32_t block;
+		uint32_t node;
+	};
+
+	struct Statistics
+	{
+		uint64_t blockCount;
+		uint64_t dedicatedBlockCount;
+		uint64_t blockBytes;
+		uint64_t allocationCount;
+		uint64_t usedBytes;
+	};
+
+private:
+	struct Node
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t prevPhysical;
+		uint32_t nextPhysical;
+		uint32_t prevFree;
+		uint32_t nextFree;
+		bool free;
+	};
+	struct Block
+	{
+		VkDeviceMemory memory;	// VK_NULL_HANDLE marks an unused slot
+		VkDeviceSize size;
+		uint8_t* mapped;
+		uint32_t memoryTypeIndex;
+		MemoryTracker::CATEGORY category;
+		bool linear;
+		bool dedicated;
+
+		uint64_t allocationCount;
+		VkDeviceSize usedBytes;
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> unusedNodes;
+
+		uint64_t flBitmap;
+		uint32_t slBitmaps[MEMORY_POOL_FL_COUNT];
+		uint32_t freeLists[MEMORY_POOL_FL_COUNT][MEMORY_POOL_SL_COUNT];
+	};
+
+	std::mutex mutex;
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	MemoryTracker* memoryTracker = nullptr;
+	VkDeviceSize blockSize = MEMORY_POOL_BLOCK_SIZE;
+	uint32_t maxMemoryAllocationCount = 0;
+
+	std::vector<Block> blocks;
+
+	static uint32_t BitScanForward(uint64_t _mask)
+	{
+		unsigned long index;
+		_BitScanForward64(&index, _mask);
+		return (uint32_t)index;
+	}
+	static uint32_t BitScanReverse(uint64_t _mask)
+	{
+		unsigned long index;
+		_BitScanReverse64(&index, _mask);
+		return (uint32_t)index;
+	}
+	static VkDeviceSize AlignUp(VkDeviceSize _value, VkDeviceSize _alignment)
+	{
+		return (_value + _alignment - 1) & ~(_alignment - 1);
+	}
+
+	// _size is at least MEMORY_POOL_MIN_ALIGNMENT, so fl is always at least MEMORY_POOL_SL_LOG2.
+	static void Mapping(VkDeviceSize _size, uint32_t& _fl, uint32_t& _sl)
+	{
+		_fl = BitScanReverse(_size);
+		_sl = (uint32_t)(_size >> (_fl - MEMORY_POOL_SL_LOG2)) - MEMORY_POOL_SL_COUNT;
+	}
+	// Rounds up to the next list, so every node found there is at least _size.
+	static void MappingSearch(VkDeviceSize _size, uint32_t& _fl, uint32_t& _sl)
+	{
+		_size += (1ull << (BitScanReverse(_size) - MEMORY_POOL_SL_LOG2)) - 1;
+		Mapping(_size, _fl, _sl);
+	}
+
+	static uint32_t NewNode(Block& _block)
+	{
+		if (_block.unusedNodes.empty() == false)
+		{
+			uint32_t node = _block.unusedNodes.back();
+			_block.unusedNodes.pop_back();
+			return node;
+		}
+		_block.nodes.push_back({});
+		return (uint32_t)_block.nodes.size() - 1;
+	}
+
+	static void InsertFree(Block& _block, uint32_t _node)
+	{
+		Node& node = _block.nodes[_node];
+		uint32_t fl, sl;
+		Mapping(node.size, fl, sl);
+
+		node.free = true;
+		node.prevFree = MEMORY_POOL_NONE;
+		node.nextFree = _block.freeLists[fl][sl];
+		if (node.nextFree != MEMORY_POOL_NONE)
+			_block.nodes[node.nextFree].prevFree = _node;
+		_block.freeLists[fl][sl] = _node;
+
+		_block.flBitmap |= 1ull << fl;
+		_block.slBitmaps[fl] |= 1u << sl;
+	}
+	static void RemoveFree(Block& _block, uint32_t _node)
+	{
+		Node& node = _block.nodes[_node];
+		uint32_t fl, sl;
+		Mapping(node.size, fl, sl);
+
+		if (node.prevFree != MEMORY_POOL_NONE)
+			_block.nodes[node.prevFree].nextFree = node.nextFree;
+		else
+			_block.freeLists[fl][sl] = node.nextFree;
+		if (node.nextFree != MEMORY_POOL_NONE)
+			_block.nodes[node.nextFree].prevFree = node.prevFree;
+
+		if (_block.freeLists[fl][sl] == MEMORY_POOL_NONE)
+		{
+			_block.slBitmaps[fl] &= ~(1u << sl);
+			if (_block.slBitmaps[fl] == 0)
+				_block.flBitmap &= ~(1ull << fl);
+		}
+		node.free = false;
+	}
+
+	// Splits [offset, offset + _size) off the front of _node and returns the new node in front of it.
+	static uint32_t SplitFront(Block& _block, uint32_t _node, VkDeviceSize _size)
+	{
+		uint32_t front = NewNode(_block);
+		Node& node = _block.nodes[_node];
+
+		_block.nodes[front] = { node.offset, _size, node.prevPhysical, _node, MEMORY_POOL_NONE, MEMORY_POOL_NONE, false };
+		if (node.prevPhysical != MEMORY_POOL_NONE)
+			_block.nodes[node.prevPhysical].nextPhysical = front;
+		node.prevPhysical = front;
+		node.offset += _size;
+		node.size -= _size;
+
+		return front;
+	}
+
+	static uint32_t AllocateNode(Block& _block, VkDeviceSize _size, VkDeviceSize _alignment)
+	{
+		VkDeviceSize searchSize = _size + (_alignment > MEMORY_POOL_MIN_ALIGNMENT ? _alignment - MEMORY_POOL_MIN_ALIGNMENT : 0);
+		uint32_t fl, sl;
+		MappingSearch(searchSize, fl, sl);
+		if (fl >= MEMORY_POOL_FL_COUNT)
+			return MEMORY_POOL_NONE;
+
+		uint32_t slMap = _block.slBitmaps[fl] & (~0u << sl);
+		if (slMap == 0)
+		{
+			uint64_t flMap = fl + 1 < MEMORY_POOL_FL_COUNT ? _block.flBitmap & (~0ull << (fl + 1)) : 0;
+			if (flMap == 0)
+				return MEMORY_POOL_NONE;
+			fl = BitScanForward(flMap);
+			slMap = _block.slBitmaps[fl];
+		}
+		sl = BitScanForward(slMap);
+
+		uint32_t node = _block.freeLists[fl][sl];
+		RemoveFree(_block, node);
+
+		VkDeviceSize padding = AlignUp(_block.nodes[node].offset, _alignment) - _block.nodes[node].offset;
+		if (padding != 0)
+			InsertFree(_block, SplitFront(_block, node, padding));
+
+		if (_block.nodes[node].size - _size >= MEMORY_POOL_MIN_ALIGNMENT)
+		{
+			uint32_t front = SplitFront(_block, node, _size);
+			InsertFree(_block, node);
+			node = front;
+		}
+
+		return node;
+	}
+	static void FreeNode(Block& _block, uint32_t _node)
+	{
+		Node& node = _block.nodes[_node];
+
+		uint32_t prev = node.prevPhysical;
+		if (prev != MEMORY_POOL_NONE && _block.nodes[prev].free)
+		{
+			RemoveFree(_block, prev);
+			node.offset = _block.nodes[prev].offset;
+			node.size += _block.nodes[prev].size;
+			node.prevPhysical = _block.nodes[prev].prevPhysical;
+			if (node.prevPhysical != MEMORY_POOL_NONE)
+				_block.nodes[node.prevPhysical].nextPhysical = _node;
+			_block.unusedNodes.push_back(prev);
+		}
+
+		uint32_t next = node.nextPhysical;
+		if (next != MEMORY_POOL_NONE && _block.nodes[next].free)
+		{
+			RemoveFree(_block, next);
+			node.size += _block.nodes[next].size;
+			node.nextPhysical = _block.nodes[next].nextPhysical;
+			if (node.nextPhysical != MEMORY_POOL_NONE)
+				_block.nodes[node.nextPhysical].prevPhysical = _node;
+			_block.unusedNodes.push_back(next);
+		}
+
+		InsertFree(_block, _node);
+	}
+
+	VkResult CreateBlock(VkDeviceSize _size, uint32_t _memoryTypeIndex, MemoryTracker::CATEGORY _category, bool _linear, bool _dedicated, uint32_t& _block)
+	{
+		VkMemoryAllocateInfo memoryAllocateInfo;
+		memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memoryAllocateInfo.pNext = nullptr;
+		memoryAllocateInfo.allocationSize = _size;
+		memoryAllocateInfo.memoryTypeIndex = _memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		VkResult result = memoryTracker->AllocateMemory(device, &memoryAllocateInfo, _category, &memory);
+		if (result != VK_SUCCESS)
+			return result;
+
+		void* mapped = nullptr;
+		if (memoryProperties.memoryTypes[_memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+			if (result != VK_SUCCESS)
+			{
+				memoryTracker->FreeMemory(device, memory);
+				return result;
+			}
+		}
+
+		_block = 0;
+		while (_block != blocks.size() && blocks[_block].memory != VK_NULL_HANDLE)
+			++_block;
+		if (_block == blocks.size())
+			blocks.emplace_back();
+
+		Block& block = blocks[_block];
+		block.memory = memory;
+		block.size = _size;
+		block.mapped = (uint8_t*)mapped;
+		block.memoryTypeIndex = _memoryTypeIndex;
+		block.category = _category;
+		block.linear = _linear;
+		block.dedicated = _dedicated;
+		block.allocationCount = 0;
+		block.usedBytes = 0;
+		block.nodes.clear();
+		block.unusedNodes.clear();
+		block.flBitmap = 0;
+		memset(block.slBitmaps, 0, sizeof(block.slBitmaps));
+		memset(block.freeLists, 0xFF, sizeof(block.freeLists));
+
+		block.nodes.push_back({ 0, _size, MEMORY_POOL_NONE, MEMORY_POOL_NONE, MEMORY_POOL_NONE, MEMORY_POOL_NONE, false });
+		InsertFree(block, 0);
+
+		return VK_SUCCESS;
+	}
+	void DestroyBlock(uint32_t _block)
+	{
+		Block& block = blocks[_block];
+		if (block.mapped != nullptr)
+			vkUnmapMemory(device, block.memory);
+		memoryTracker->FreeMemory(device, block.memory);
+
+		block.memory = VK_NULL_HANDLE;
+		block.mapped = nullptr;
+		block.nodes.clear();
+		block.nodes.shrink_to_fit();
+		block.unusedNodes.clear();
+		block.unusedNodes.shrink_to_fit();
+	}
+
+public:
+	void Init(VkDevice _device, VkPhysicalDeviceMemoryProperties _memoryProperties, uint32_t _maxMemoryAllocationCount, MemoryTracker* _memoryTracker, VkDeviceSize _blockSize = MEMORY_POOL_BLOCK_SIZE)
+	{
+		device = _device;
+		memoryProperties = _memoryProperties;
+		maxMemoryAllocationCount = _maxMemoryAllocationCount;
+		memoryTracker = _memoryTracker;
+		blockSize = _blockSize;
+	}
+
+	// _linear is true for buffers and linear images, false for optimal images.
+	VkResult Allocate(VkMemoryRequirements _memoryRequirements, uint32_t _memoryTypeIndex, MemoryTracker::CATEGORY _category, bool _linear, Allocation& _allocation)
+	{
+		VkDeviceSize size = AlignUp(_memoryRequirements.size, MEMORY_POOL_MIN_ALIGNMENT);
+		VkDeviceSize alignment = _memoryRequirements.alignment > MEMORY_POOL_MIN_ALIGNMENT ? _memoryRequirements.alignment : MEMORY_POOL_MIN_ALIGNMENT;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint32_t block = MEMORY_POOL_NONE;
+		uint32_t node = MEMORY_POOL_NONE;
+
+		if (size > blockSize / 2)
+		{
+			VkResult result = CreateBlock(size, _memoryTypeIndex, _category, _linear, true, block);
+			if (result != VK_SUCCESS)
+				return result;
+			node = 0;
+			RemoveFree(blocks[block], node);
+		}
+		else
+		{
+			for (uint32_t b = 0; b != blocks.size() && node == MEMORY_POOL_NONE; ++b)
+			{
+				if (blocks[b].memory == VK_NULL_HANDLE || blocks[b].dedicated || blocks[b].memoryTypeIndex != _memoryTypeIndex || blocks[b].category != _category || blocks[b].linear != _linear)
+					continue;
+
+				node = AllocateNode(blocks[b], size, alignment);
+				block = b;
+			}
+			if (node == MEMORY_POOL_NONE)
+			{
+				VkResult result = CreateBlock(blockSize, _memoryTypeIndex, _category, _linear, false, block);
+				if (result != VK_SUCCESS)
+					return result;
+				node = AllocateNode(blocks[block], size, alignment);
+			}
+		}
+
+		Block& owner = blocks[block];
+		++owner.allocationCount;
+		owner.usedBytes += owner.nodes[node].size;
+
+		_allocation.handle = owner.memory;
+		_allocation.offset = owner.nodes[node].offset;
+		_allocation.size = owner.nodes[node].size;
+		_allocation.mapped = owner.mapped != nullptr ? owner.mapped + _allocation.offset : nullptr;
+		_allocation.block = block;
+		_allocation.node = node;
+
+		return VK_SUCCESS;
+	}
+	// Empty blocks are released unless they are the last one of their kind.
+	void Free(Allocation& _allocation)
+	{
+		if (_allocation.handle == VK_NULL_HANDLE)
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Block& block = blocks[_allocation.block];
+		FreeNode(block, _allocation.node);
+		--block.allocationCount;
+		block.usedBytes -= _allocation.size;
+
+		if (block.allocationCount == 0)
+		{
+			bool release = block.dedicated;
+			for (uint32_t b = 0; b != blocks.size() && release == false; ++b)
+			{
+				if (b != _allocation.block && blocks[b].memory != VK_NULL_HANDLE && blocks[b].dedicated == false && blocks[b].memoryTypeIndex == block.memoryTypeIndex && blocks[b].category == block.category && blocks[b].linear == block.linear)
+					release = true;
+			}
+			if (release)
+				DestroyBlock(_allocation.block);
+		}
+
+		_allocation = {};
+	}
+
+	// Releases every block. Returns the number of allocations that were still alive.
+	uint64_t Destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint64_t leaked = 0;
+		for (uint32_t b = 0; b != blocks.size(); ++b)
+		{
+			if (blocks[b].memory == VK_NULL_HANDLE)
+				continue;
+			leaked += blocks[b].allocationCount;
+			DestroyBlock(b);
+		}
+		blocks.clear();
+
+		return leaked;
+	}
+
+	Statistics GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Statistics statistics = {};
+		for (size_t b = 0; b != blocks.size(); ++b)
+		{
+			if (blocks[b].memory == VK_NULL_HANDLE)
+				continue;
+			++statistics.blockCount;
+			if (blocks[b].dedicated)
+				++statistics.dedicatedBlockCount;
+			statistics.blockBytes += blocks[b].size;
+			statistics.allocationCount += blocks[b].allocationCount;
+			statistics.usedBytes += blocks[b].usedBytes;
+		}
+		return statistics;
+	}
+	uint32_t GetMaxMemoryAllocationCount()
+	{
+		return maxMemoryAllocationCount;
+	}
+
+	// Walks every block: nodes must tile it without gaps, no two free nodes may be neighbours
+	// and every free node must be in the list its size maps to.
+	bool Validate()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (size_t b = 0; b != blocks.size(); ++b)
+		{
+			const Block& block = blocks[b];
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+
+			uint32_t node = MEMORY_POOL_NONE;
+			for (uint32_t n = 0; n != block.nodes.size(); ++n)
+			{
+				bool unused = false;
+				for (size_t u = 0; u != block.unusedNodes.size(); ++u)
+					unused |= block.unusedNodes[u] == n;
+				if (unused == false && block.nodes[n].prevPhysical == MEMORY_POOL_NONE)
+					node = n;
+			}
+
+			VkDeviceSize offset = 0;
+			uint64_t freeNodes = 0;
+			uint64_t usedNodes = 0;
+			bool previousFree = false;
+			for (; node != MEMORY_POOL_NONE; node = block.nodes[node].nextPhysical)
+			{
+				const Node& current = block.nodes[node];
+				if (current.offset != offset || current.size == 0 || (current.free && previousFree))
+					return false;
+				offset += current.size;
+				previousFree = current.free;
+				current.free ? ++freeNodes : ++usedNodes;
+			}
+			if (offset != block.size || usedNodes != block.allocationCount)
+				return false;
+
+			uint64_t listedNodes = 0;
+			for (uint32_t fl = 0; fl != MEMORY_POOL_FL_COUNT; ++fl)
+			{
+				for (uint32_t sl = 0; sl != MEMORY_POOL_SL_COUNT; ++sl)
+				{
+					if ((block.freeLists[fl][sl] != MEMORY_POOL_NONE) != ((block.slBitmaps[fl] >> sl) & 1))
+						return false;
+					for (uint32_t n = block.freeLists[fl][sl]; n != MEMORY_POOL_NONE; n = block.nodes[n].nextFree)
+					{
+						uint32_t nodeFl, nodeSl;
+						Mapping(block.nodes[n].size, nodeFl, nodeSl);
+						if (block.nodes[n].free == false || nodeFl != fl || nodeSl != sl)
+							return false;
+						++listedNodes;
+					}
+				}
+			}
+			if (listedNodes != freeNodes)
+				return false;
+		}
+
+		return true;
+	}
+};
+
+#endif
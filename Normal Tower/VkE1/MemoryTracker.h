@@ -0,0 +1,296 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <stdint.h>
+#include <malloc.h>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan\vulkan.h>
+
+#define MEMORY_TRACKER
+
+// Accounts host memory the driver allocates through VkAllocationCallbacks and device memory
+// allocated through AllocateMemory/FreeMemory, per category. Every host allocation carries a
+// small header with its size and category, so any category's callbacks can free it.
+class MemoryTracker
+{
+public:
+	enum CATEGORY
+	{
+		CATEGORY_OTHER,
+		CATEGORY_SWAPCHAIN,
+		CATEGORY_DEPTH,
+		CATEGORY_TEXTURES,
+		CATEGORY_VERTEX_INDEX,
+		CATEGORY_UNIFORMS,
+		CATEGORY_STAGING,
+		CATEGORY_COUNT,
+	};
+
+	struct Statistics
+	{
+		uint64_t bytes;
+		uint64_t peakBytes;
+		uint64_t allocations;		// live
+		uint64_t totalAllocations;	// ever made
+	};
+
+private:
+	struct HostHeader
+	{
+		size_t size;
+		size_t offset;	// from the start of the system allocation to the user pointer
+		CATEGORY category;
+	};
+	struct DeviceAllocation
+	{
+		VkDeviceSize size;
+		CATEGORY category;
+	};
+	struct CategoryUserData
+	{
+		MemoryTracker* tracker;
+		CATEGORY category;
+	};
+
+	std::mutex mutex;
+
+	CategoryUserData userData[CATEGORY_COUNT];
+	VkAllocationCallbacks callbacks[CATEGORY_COUNT];
+
+	Statistics host[CATEGORY_COUNT] = {};
+	Statistics hostInternal[CATEGORY_COUNT] = {};
+	Statistics device[CATEGORY_COUNT] = {};
+	Statistics hostTotal = {};
+	Statistics deviceTotal = {};
+
+	VkDeviceSize deviceBudgets[CATEGORY_COUNT] = {};	// 0 means no budget
+	uint64_t overBudgetAllocations[CATEGORY_COUNT] = {};
+
+	std::unordered_map<VkDeviceMemory, DeviceAllocation> deviceAllocations;
+
+	static void Add(Statistics& _statistics, uint64_t _bytes)
+	{
+		_statistics.bytes += _bytes;
+		++_statistics.allocations;
+		++_statistics.totalAllocations;
+		if (_statistics.bytes > _statistics.peakBytes)
+			_statistics.peakBytes = _statistics.bytes;
+	}
+	static void Remove(Statistics& _statistics, uint64_t _bytes)
+	{
+		_statistics.bytes -= _bytes;
+		--_statistics.allocations;
+	}
+
+	static void* VKAPI_CALL Allocation(void* _userData, size_t _size, size_t _alignment, VkSystemAllocationScope _allocationScope)
+	{
+		CategoryUserData* userData = (CategoryUserData*)_userData;
+
+		if (_alignment < alignof(HostHeader))
+			_alignment = alignof(HostHeader);
+		size_t offset = (sizeof(HostHeader) + _alignment - 1) & ~(_alignment - 1);
+
+		uint8_t* base = (uint8_t*)_aligned_malloc(offset + _size, _alignment);
+		if (base == nullptr)
+			return nullptr;
+
+		HostHeader* header = (HostHeader*)(base + offset) - 1;
+		header->size = _size;
+		header->offset = offset;
+		header->category = userData->category;
+
+		std::lock_guard<std::mutex> lock(userData->tracker->mutex);
+		Add(userData->tracker->host[userData->category], _size);
+		Add(userData->tracker->hostTotal, _size);
+
+		return base + offset;
+	}
+	static void VKAPI_CALL Free(void* _userData, void* _memory)
+	{
+		if (_memory == nullptr)
+			return;
+
+		CategoryUserData* userData = (CategoryUserData*)_userData;
+		HostHeader* header = (HostHeader*)_memory - 1;
+
+		{
+			std::lock_guard<std::mutex> lock(userData->tracker->mutex);
+			Remove(userData->tracker->host[header->category], header->size);
+			Remove(userData->tracker->hostTotal, header->size);
+		}
+
+		_aligned_free((uint8_t*)_memory - header->offset);
+	}
+	static void* VKAPI_CALL Reallocation(void* _userData, void* _original, size_t _size, size_t _alignment, VkSystemAllocationScope _allocationScope)
+	{
+		if (_original == nullptr)
+			return Allocation(_userData, _size, _alignment, _allocationScope);
+		if (_size == 0)
+		{
+			Free(_userData, _original);
+			return nullptr;
+		}
+
+		void* memory = Allocation(_userData, _size, _alignment, _allocationScope);
+		if (memory == nullptr)
+			return nullptr;
+
+		size_t originalSize = ((HostHeader*)_original - 1)->size;
+		memcpy(memory, _original, originalSize < _size ? originalSize : _size);
+		Free(_userData, _original);
+
+		return memory;
+	}
+	static void VKAPI_CALL InternalAllocation(void* _userData, size_t _size, VkInternalAllocationType _allocationType, VkSystemAllocationScope _allocationScope)
+	{
+		CategoryUserData* userData = (CategoryUserData*)_userData;
+		std::lock_guard<std::mutex> lock(userData->tracker->mutex);
+		Add(userData->tracker->hostInternal[userData->category], _size);
+	}
+	static void VKAPI_CALL InternalFree(void* _userData, size_t _size, VkInternalAllocationType _allocationType, VkSystemAllocationScope _allocationScope)
+	{
+		CategoryUserData* userData = (CategoryUserData*)_userData;
+		std::lock_guard<std::mutex> lock(userData->tracker->mutex);
+		Remove(userData->tracker->hostInternal[userData->category], _size);
+	}
+
+public:
+	static const char* CategoryName(CATEGORY _category)
+	{
+		static const char* names[CATEGORY_COUNT] = { "other", "swapchain", "depth", "textures", "vertex/index", "uniforms", "staging" };
+		return names[_category];
+	}
+
+	MemoryTracker()
+	{
+		for (size_t i = 0; i != CATEGORY_COUNT; ++i)
+		{
+			userData[i].tracker = this;
+			userData[i].category = (CATEGORY)i;
+
+			callbacks[i].pUserData = &userData[i];
+			callbacks[i].pfnAllocation = Allocation;
+			callbacks[i].pfnReallocation = Reallocation;
+			callbacks[i].pfnFree = Free;
+			callbacks[i].pfnInternalAllocation = InternalAllocation;
+			callbacks[i].pfnInternalFree = InternalFree;
+		}
+	}
+
+	// Pass to every vkCreate*/vkDestroy*, the callbacks of all categories are compatible with each other.
+	const VkAllocationCallbacks* Callbacks(CATEGORY _category)
+	{
+#ifdef MEMORY_TRACKER
+		return &callbacks[_category];
+#else
+		return nullptr;
+#endif
+	}
+
+	VkResult AllocateMemory(VkDevice _vkDevice, const VkMemoryAllocateInfo* _memoryAllocateInfo, CATEGORY _category, VkDeviceMemory* _memory)
+	{
+		VkResult result = vkAllocateMemory(_vkDevice, _memoryAllocateInfo, Callbacks(_category), _memory);
+		if (result != VK_SUCCESS)
+			return result;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		deviceAllocations[*_memory] = { _memoryAllocateInfo->allocationSize, _category };
+		Add(device[_category], _memoryAllocateInfo->allocationSize);
+		Add(deviceTotal, _memoryAllocateInfo->allocationSize);
+
+		if (deviceBudgets[_category] != 0 && device[_category].bytes > deviceBudgets[_category])
+			++overBudgetAllocations[_category];
+
+		return result;
+	}
+	void FreeMemory(VkDevice _vkDevice, VkDeviceMemory _memory)
+	{
+		if (_memory == VK_NULL_HANDLE)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto allocation = deviceAllocations.find(_memory);
+			if (allocation != deviceAllocations.end())
+			{
+				Remove(device[allocation->second.category], allocation->second.size);
+				Remove(deviceTotal, allocation->second.size);
+				deviceAllocations.erase(allocation);
+			}
+		}
+
+		vkFreeMemory(_vkDevice, _memory, Callbacks(CATEGORY_OTHER));
+	}
+
+	// Allocations that push a category past its budget still succeed, they are counted and reported.
+	void SetDeviceBudget(CATEGORY _category, VkDeviceSize _budget)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		deviceBudgets[_category] = _budget;
+	}
+	bool IsOverBudget()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i != CATEGORY_COUNT; ++i)
+		{
+			if (overBudgetAllocations[i] != 0)
+				return true;
+		}
+		return false;
+	}
+
+	Statistics GetHostStatistics(CATEGORY _category)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return host[_category];
+	}
+	Statistics GetDeviceStatistics(CATEGORY _category)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return device[_category];
+	}
+	Statistics GetHostTotal()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return hostTotal;
+	}
+	Statistics GetDeviceTotal()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return deviceTotal;
+	}
+
+	// Live values are leaks when written after everything was destroyed.
+	bool Report(const char* _filename)
+	{
+		FILE* file = fopen(_filename, "w");
+		if (file == NULL)
+			return false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		fprintf(file, "%-14s %14s %14s %10s %10s | %14s %14s %10s %10s | %14s %14s | %14s %10s\n", "category", "host live", "host peak", "live", "total", "device live", "device peak", "live", "total", "internal live", "internal peak", "budget", "over");
+		for (size_t i = 0; i != CATEGORY_COUNT; ++i)
+		{
+			fprintf(file, "%-14s %14llu %14llu %10llu %10llu | %14llu %14llu %10llu %10llu | %14llu %14llu | %14llu %10llu\n", CategoryName((CATEGORY)i),
+				(unsigned long long)host[i].bytes, (unsigned long long)host[i].peakBytes, (unsigned long long)host[i].allocations, (unsigned long long)host[i].totalAllocations,
+				(unsigned long long)device[i].bytes, (unsigned long long)device[i].peakBytes, (unsigned long long)device[i].allocations, (unsigned long long)device[i].totalAllocations,
+				(unsigned long long)hostInternal[i].bytes, (unsigned long long)hostInternal[i].peakBytes,
+				(unsigned long long)deviceBudgets[i], (unsigned long long)overBudgetAllocations[i]);
+		}
+		fprintf(file, "%-14s %14llu %14llu %10llu %10llu | %14llu %14llu %10llu %10llu\n", "total",
+			(unsigned long long)hostTotal.bytes, (unsigned long long)hostTotal.peakBytes, (unsigned long long)hostTotal.allocations, (unsigned long long)hostTotal.totalAllocations,
+			(unsigned long long)deviceTotal.bytes, (unsigned long long)deviceTotal.peakBytes, (unsigned long long)deviceTotal.allocations, (unsigned long long)deviceTotal.totalAllocations);
+
+		fclose(file);
+		return true;
+	}
+};
+
+#endif
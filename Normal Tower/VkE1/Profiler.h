@@ -0,0 +1,256 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <Windows.h>
+
+#include "Timer.h"
+
+#define PROFILER
+
+#define PROFILER_EVENT_CAPACITY 65536 // zone events kept for export, must be a power of two
+#define PROFILER_FRAME_ZONE_COUNT 64 // distinct zones aggregated per frame
+#define PROFILER_GPU_THREAD_ID 0xFFFFFFFF // thread id the GPU zones are exported under
+
+#ifdef PROFILER
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILER_CONCAT(profilerZone, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::Get().EndFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FRAME()
+#endif
+
+// Scoped CPU zones. Every closed zone is stored in a ring of events that can be saved
+// as Chrome trace-event JSON (chrome://tracing), and EndFrame aggregates the zones of
+// the frame that just ended by name.
+class Profiler
+{
+public:
+	struct Event
+	{
+		const char* name;
+		uint64_t start;	// nanoseconds since the profiler was created
+		uint64_t end;	// nanoseconds since the profiler was created
+		uint32_t threadId;
+		uint32_t depth;
+	};
+
+	struct FrameZone
+	{
+		const char* name;
+		uint32_t depth;
+		uint32_t count;
+		uint64_t time;	// nanoseconds
+	};
+
+	class Zone
+	{
+		const char* name;
+		uint64_t start;
+
+	public:
+		Zone(const char* _name)
+		{
+			name = _name;
+			start = Profiler::Get().Begin();
+		}
+		~Zone()
+		{
+			Profiler::Get().End(name, start);
+		}
+	};
+
+private:
+	long long origin;
+
+	Event events[PROFILER_EVENT_CAPACITY];
+	std::atomic<uint64_t> writeIndex{ 0 };
+
+	uint64_t frameStart = 0;
+	uint64_t frameIndex = 0;
+	uint64_t frameEventIndex = 0;
+
+	FrameZone frameZones[PROFILER_FRAME_ZONE_COUNT];
+	uint32_t frameZoneCount = 0;
+	uint64_t frameTime = 0;
+
+	FrameZone slowestFrameZones[PROFILER_FRAME_ZONE_COUNT];
+	uint32_t slowestFrameZoneCount = 0;
+	uint64_t slowestFrameTime = 0;
+
+	static uint32_t& ThreadDepth()
+	{
+		static thread_local uint32_t depth = 0;
+		return depth;
+	}
+	static uint32_t ThreadId()
+	{
+		static thread_local uint32_t threadId = (uint32_t)GetCurrentThreadId();
+		return threadId;
+	}
+
+	Profiler()
+	{
+		origin = Timer::GetTimestamp();
+	}
+
+public:
+	// Also used directly for events measured elsewhere, like GPU timestamps read back frames later.
+	void Add(const char* _name, uint64_t _start, uint64_t _end, uint32_t _depth, uint32_t _threadId = ThreadId())
+	{
+		uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+		Event& event = events[index & (PROFILER_EVENT_CAPACITY - 1)];
+		event.name = _name;
+		event.start = _start;
+		event.end = _end;
+		event.threadId = _threadId;
+		event.depth = _depth;
+	}
+
+	static Profiler& Get()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	uint64_t Now()
+	{
+		return (uint64_t)(Timer::GetTimestamp() - origin);
+	}
+
+	uint64_t Begin()
+	{
+		++ThreadDepth();
+		return Now();
+	}
+	void End(const char* _name, uint64_t _start)
+	{
+		uint64_t end = Now();
+		Add(_name, _start, end, --ThreadDepth());
+	}
+
+	// Closes the current frame: adds a "Frame" event spanning it and sums its zones by name.
+	void EndFrame()
+	{
+		uint64_t end = Now();
+		Add("Frame", frameStart, end, 0);
+
+		uint64_t eventEnd = writeIndex.load();
+		uint64_t eventStart = frameEventIndex;
+		if (eventEnd - eventStart > PROFILER_EVENT_CAPACITY)
+			eventStart = eventEnd - PROFILER_EVENT_CAPACITY;
+
+		frameZoneCount = 0;
+		for (uint64_t i = eventStart; i != eventEnd; ++i)
+		{
+			const Event& event = events[i & (PROFILER_EVENT_CAPACITY - 1)];
+
+			uint32_t z = 0;
+			while (z != frameZoneCount && frameZones[z].name != event.name)
+				++z;
+
+			if (z == frameZoneCount)
+			{
+				if (frameZoneCount == PROFILER_FRAME_ZONE_COUNT)
+					continue;
+
+				frameZones[z] = { event.name, event.depth, 0, 0 };
+				++frameZoneCount;
+			}
+
+			++frameZones[z].count;
+			frameZones[z].time += event.end - event.start;
+		}
+
+		frameTime = end - frameStart;
+		if (frameTime > slowestFrameTime && frameIndex != 0)
+		{
+			slowestFrameTime = frameTime;
+			slowestFrameZoneCount = frameZoneCount;
+			memcpy(slowestFrameZones, frameZones, sizeof(FrameZone) * frameZoneCount);
+		}
+
+		frameStart = end;
+		frameEventIndex = eventEnd;
+		++frameIndex;
+	}
+
+	const FrameZone* GetFrameZones(uint32_t& _count, uint64_t& _frameTime)
+	{
+		_count = frameZoneCount;
+		_frameTime = frameTime;
+		return frameZones;
+	}
+	// The first frame is left out, it contains the whole startup.
+	const FrameZone* GetSlowestFrameZones(uint32_t& _count, uint64_t& _frameTime)
+	{
+		_count = slowestFrameZoneCount;
+		_frameTime = slowestFrameTime;
+		return slowestFrameZones;
+	}
+	uint64_t GetFrameIndex()
+	{
+		return frameIndex;
+	}
+
+	// Writes the CPU zones that lie within [_start, _end] as an indented text timeline ordered by start.
+	bool SaveTimeline(const char* _filename, uint64_t _start, uint64_t _end)
+	{
+		uint64_t count = writeIndex.load();
+		uint64_t first = count > PROFILER_EVENT_CAPACITY ? count - PROFILER_EVENT_CAPACITY : 0;
+
+		std::vector<Event> timeline;
+		for (uint64_t i = first; i != count; ++i)
+		{
+			const Event& event = events[i & (PROFILER_EVENT_CAPACITY - 1)];
+			if (event.threadId != PROFILER_GPU_THREAD_ID && event.start >= _start && event.end <= _end)
+				timeline.push_back(event);
+		}
+		std::sort(timeline.begin(), timeline.end(), [](const Event& _a, const Event& _b) { return _a.start != _b.start ? _a.start < _b.start : _a.depth < _b.depth; });
+
+		FILE* file = fopen(_filename, "w");
+		if (file == NULL)
+			return false;
+
+		fprintf(file, "%12s %12s  %s\n", "start ms", "duration ms", "zone");
+		for (size_t i = 0; i != timeline.size(); ++i)
+			fprintf(file, "%12.3f %12.3f  %*s%s\n", (timeline[i].start - _start) * 0.000001, (timeline[i].end - timeline[i].start) * 0.000001, timeline[i].depth * 2, "", timeline[i].name);
+		fprintf(file, "%12.3f %12.3f  %s\n", 0.0, (_end - _start) * 0.000001, "total");
+
+		fclose(file);
+		return true;
+	}
+
+	// Writes the events still in the ring as Chrome trace-event JSON, timestamps in microseconds.
+	bool Save(const char* _filename)
+	{
+		FILE* file = fopen(_filename, "w");
+		if (file == NULL)
+			return false;
+
+		uint64_t count = writeIndex.load();
+		uint64_t first = count > PROFILER_EVENT_CAPACITY ? count - PROFILER_EVENT_CAPACITY : 0;
+
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}\n", PROFILER_GPU_THREAD_ID);
+		for (uint64_t i = first; i != count; ++i)
+		{
+			const Event& event = events[i & (PROFILER_EVENT_CAPACITY - 1)];
+			fprintf(file, ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"depth\":%u}}\n", event.name, event.threadId == PROFILER_GPU_THREAD_ID ? "gpu" : "cpu", event.start * 0.001, (event.end - event.start) * 0.001, event.threadId, event.depth);
+		}
+		fprintf(file, "]}\n");
+
+		fclose(file);
+		return true;
+	}
+};
+
+#endif
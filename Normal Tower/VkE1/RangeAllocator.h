@@ -0,0 +1,111 @@
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+// First fit sub-allocation of [0, capacity) in whatever unit the caller counts, elements
+// of a buffer for example. The free ranges are kept sorted by offset and a freed range
+// is merged with its neighbours, so freeing everything leaves a single range again.
+class RangeAllocator
+{
+public:
+	struct Range
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+private:
+	std::vector<Range> freeRanges;
+	uint64_t capacity = 0;
+	uint64_t usedSize = 0;
+
+public:
+	void Init(uint64_t _capacity)
+	{
+		capacity = _capacity;
+		usedSize = 0;
+
+		freeRanges.clear();
+		if (_capacity != 0)
+			freeRanges.push_back({ 0, _capacity });
+	}
+
+	// Returns false when no free range holds _size.
+	bool Allocate(uint64_t _size, uint64_t& _offset)
+	{
+		if (_size == 0)
+		{
+			_offset = 0;
+			return true;
+		}
+
+		for (size_t i = 0; i != freeRanges.size(); ++i)
+		{
+			if (freeRanges[i].size < _size)
+				continue;
+
+			_offset = freeRanges[i].offset;
+			freeRanges[i].offset += _size;
+			freeRanges[i].size -= _size;
+			if (freeRanges[i].size == 0)
+				freeRanges.erase(freeRanges.begin() + i);
+
+			usedSize += _size;
+			return true;
+		}
+
+		return false;
+	}
+	void Free(uint64_t _offset, uint64_t _size)
+	{
+		if (_size == 0)
+			return;
+
+		// first free range behind the freed one
+		size_t next = 0;
+		while (next != freeRanges.size() && freeRanges[next].offset < _offset)
+			++next;
+
+		bool mergePrevious = next != 0 && freeRanges[next - 1].offset + freeRanges[next - 1].size == _offset;
+		bool mergeNext = next != freeRanges.size() && _offset + _size == freeRanges[next].offset;
+
+		if (mergePrevious && mergeNext)
+		{
+			freeRanges[next - 1].size += _size + freeRanges[next].size;
+			freeRanges.erase(freeRanges.begin() + next);
+		}
+		else if (mergePrevious)
+		{
+			freeRanges[next - 1].size += _size;
+		}
+		else if (mergeNext)
+		{
+			freeRanges[next].offset = _offset;
+			freeRanges[next].size += _size;
+		}
+		else
+		{
+			freeRanges.insert(freeRanges.begin() + next, { _offset, _size });
+		}
+
+		usedSize -= _size;
+	}
+
+	uint64_t GetCapacity() const
+	{
+		return capacity;
+	}
+	uint64_t GetUsedSize() const
+	{
+		return usedSize;
+	}
+	size_t GetFreeRangeCount() const
+	{
+		return freeRanges.size();
+	}
+};
+
+#endif
@@ -1,24 +1,63 @@
 #include "Renderer.h"
 
 #include <assert.h>
+#include <intrin.h>
+#include <algorithm>
+#include <random>
 
 #include "Engine.h"
 
 #define GRAPHICS_PRESENT_QUEUE_INDEX 0
+#define TRANSFER_QUEUE_INDEX 1 // only present when the device has a transfer family without graphics
 
 #define VIEW_PROJECTION_UNIFORM_BINDING 0
 #define MODEL_MATRICES_UNIFORM_BINDING 1
 #define POINT_LIGHT_UNIFORM_BINDING 2
 #define TEXTURE_UNIFORM_BINDING 3
 
-void Renderer::Init()
+#define BAR_WINDOW_SIZE (256ull << 20) // host visible device local memory without resizable BAR
+#define GEOMETRY_VERTEX_CAPACITY (512 << 10) // vertices shared by all meshes
+#define GEOMETRY_INDEX_CAPACITY (2 << 20) // indices shared by all meshes
+#define TRANSFER_BATCH_SLOT_COUNT 2 // batches that can be in flight while the next one is recorded
+#define TRANSFER_STAGING_BLOCK_SIZE (8 << 20) // bytes, staging blocks are shared by all transfers of a batch
+
+#define TEXTURE_MIPMAPS // full mip chains, box filtered on the workers right after decoding
+#define MESH_CACHE // LoadModel reads and writes a binary cache next to each model instead of importing it every start
+#define MESH_CACHE_MAGIC 0x434D4B56 // "VKMC"
+#define MESH_CACHE_VERSION 1 // bump whenever ImportModel's output or the cache layout changes
+
+#define GPU_TIMESTAMP_RENDER_PASS_BEGIN 0
+#define GPU_TIMESTAMP_DRAW_0_BEGIN 1
+#define GPU_TIMESTAMP_DRAW_0_END 2
+#define GPU_TIMESTAMP_DRAW_1_END 3
+#define GPU_TIMESTAMP_ADDED_MODELS_BEGIN 4
+#define GPU_TIMESTAMP_ADDED_MODELS_END 5
+#define GPU_TIMESTAMP_RENDER_PASS_END 6
+#define GPU_TIMESTAMP_COUNT 7
+
+#define GPU_PIPELINE_STATISTICS_QUERY
+#define GPU_PIPELINE_STATISTICS (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+#define GPU_PIPELINE_STATISTICS_COUNT 3
+
+void Renderer::Init(bool _headless)
 {
+	PROFILE_ZONE("Renderer::Init");
+
 	/// Logger
 	{
+		PROFILE_ZONE("Logger");
 #if _DEBUG
-		logger.Start("_RendererLogger.txt");
-		debugReportCallbackLogger.Start("DebugReportCallbackLogger.txt");
-		cleanUpLogger.Start("_RendererCleanUpLogger.txt");
+		logger.Start("_RendererLogger.txt", Logger::MODE_ASYNC);
+		debugReportCallbackLogger.Start("DebugReportCallbackLogger.txt", Logger::MODE_ASYNC);
+		debugReportSink.Start(&debugReportCallbackLogger);
+#endif
+	}
+
+	/// Call trace
+	{
+		PROFILE_ZONE("Call trace");
+#if _DEBUG || defined(VK_CALL_TRACE)
+		callTrace.Start(65536);
 #endif
 	}
 
@@ -43,6 +82,7 @@ void Renderer::Init()
 #endif
 	};
 	{
+		PROFILE_ZONE("Instance");
 		VkApplicationInfo applicationInfo;
 		applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 		applicationInfo.pNext = nullptr;
@@ -110,12 +150,13 @@ void Renderer::Init()
 		instanceCreateInfo.enabledExtensionCount = (uint32_t)enabledInstanceExtensionNames.size();
 		instanceCreateInfo.ppEnabledExtensionNames = enabledInstanceExtensionNames.data();
 
-		VK_CHECK_RESULT(vkCreateInstance(&instanceCreateInfo, nullptr, &instance), instance, "vkCreateInstance");
+		VK_CHECK_RESULT(vkCreateInstance(&instanceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &instance), instance, "vkCreateInstance");
 	}
 
 	/// Debug
 	VkDebugReportFlagsEXT debugFlags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT | VK_DEBUG_REPORT_DEBUG_BIT_EXT | VK_DEBUG_REPORT_INFORMATION_BIT_EXT;;;
 	{
+		PROFILE_ZONE("Debug");
 #if _DEBUG
 		VkDebugReportCallbackCreateInfoEXT debugReportCallbackCreateInfo;
 		debugReportCallbackCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
@@ -125,7 +166,7 @@ void Renderer::Init()
 		debugReportCallbackCreateInfo.pUserData = nullptr;
 
 		PFN_vkCreateDebugReportCallbackEXT FP_vkCreateDebugReportCallbackEXT = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
-		VK_CHECK_RESULT(FP_vkCreateDebugReportCallbackEXT(instance, &debugReportCallbackCreateInfo, nullptr, &debugReportCallback), debugReportCallback, "FP_vkCreateDebugReportCallbackEXT");
+		VK_CHECK_RESULT(FP_vkCreateDebugReportCallbackEXT(instance, &debugReportCallbackCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &debugReportCallback), debugReportCallback, "FP_vkCreateDebugReportCallbackEXT");
 #else
 		debugReportCallback = VK_NULL_HANDLE;
 #endif
@@ -133,6 +174,7 @@ void Renderer::Init()
 
 	/// Physical Device
 	{
+		PROFILE_ZONE("Physical Device");
 		uint32_t propertyCount = 0;
 		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &propertyCount, nullptr), "????????????????", "vkEnumeratePhysicalDevices");
 		std::vector<VkPhysicalDevice> physicalDevicesHandles(propertyCount);
@@ -167,11 +209,13 @@ void Renderer::Init()
 	const char* windowName = "Window Name";
 	WNDPROC wndProc = nullptr;
 	{
-		window = VkU::GetWindow(width, height, windowTitle, windowName, wndProc);
+		PROFILE_ZONE("OS Window");
+		window = VkU::GetWindow(width, height, windowTitle, windowName, wndProc, _headless == false);
 	}
 
 	/// Surface
 	{
+		PROFILE_ZONE("Surface");
 		VkWin32SurfaceCreateInfoKHR win32SurfaceCreateInfo;
 		win32SurfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 		win32SurfaceCreateInfo.pNext = nullptr;
@@ -179,12 +223,13 @@ void Renderer::Init()
 		win32SurfaceCreateInfo.hinstance = window.hInstance;
 		win32SurfaceCreateInfo.hwnd = window.hWnd;
 
-		VK_CHECK_RESULT(vkCreateWin32SurfaceKHR(instance, &win32SurfaceCreateInfo, nullptr, &surface.handle), surface.handle, "vkCreateWin32SurfaceKHR");
+		VK_CHECK_RESULT(vkCreateWin32SurfaceKHR(instance, &win32SurfaceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &surface.handle), surface.handle, "vkCreateWin32SurfaceKHR");
 	}
 
 	/// PhysicalDevice & Queue picking
 	std::vector<VkU::Queue> queue = { VkU::Queue::GetQueue(VK_TRUE, VK_QUEUE_GRAPHICS_BIT, 1.0f, 1) };
 	{
+		PROFILE_ZONE("PhysicalDevice & Queue picking");
 		device.physicalDeviceIndex = -1;
 
 		for (size_t i = 0; i != physicalDevices.size(); ++i)
@@ -198,11 +243,45 @@ void Renderer::Init()
 				break;
 			}
 		}
+
+		// uploads go to a queue of their own when a family without graphics can take them
+		uint32_t transferFamilyIndex = VkU::FindDedicatedQueueFamilyIndex(physicalDevices[device.physicalDeviceIndex], VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT);
+		if (transferFamilyIndex != (uint32_t)-1)
+		{
+			VkU::Queue transferQueue = VkU::Queue::GetQueue(VK_FALSE, VK_QUEUE_TRANSFER_BIT, 1.0f, 1);
+			transferQueue.queueFamilyIndex = transferFamilyIndex;
+			transferQueue.queueIndex = 0;
+			device.queues.push_back(transferQueue);
+		}
+#if _DEBUG
+		else
+			logger << "WARNING: No dedicated transfer queue family, uploads use the graphics queue.\n";
+#endif
+	}
+
+	/// Memory topology
+	{
+		PROFILE_ZONE("Memory topology");
+		memoryTopology = VkU::GetMemoryTopology(physicalDevices[device.physicalDeviceIndex]);
+
+		hostWriteMemoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		if (memoryTopology != VkU::MEMORY_TOPOLOGY_DISCRETE)
+			hostWriteMemoryPropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		else
+			directUpload = false;
+
+#if _DEBUG
+		const char* memoryTopologyNames[] = { "discrete", "resizable BAR", "unified" };
+		logger << "Memory topology: " << memoryTopologyNames[memoryTopology] << (directUpload ? ", geometry is written in place.\n" : ", geometry is staged.\n");
+#endif
 	}
 
 	/// Device
 	VkPhysicalDeviceFeatures features = {};
 	features.samplerAnisotropy = true;
+#ifdef GPU_PIPELINE_STATISTICS_QUERY
+	features.pipelineStatisticsQuery = physicalDevices[device.physicalDeviceIndex].features.pipelineStatisticsQuery;
+#endif
 	std::vector<const char*> enabledDeviceLayerNames =
 	{
 #if _DEBUG
@@ -214,7 +293,8 @@ void Renderer::Init()
 		"VK_KHR_swapchain",
 	};
 	{
-		std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos(queue.size());
+		PROFILE_ZONE("Device");
+		std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos(device.queues.size());
 		for (size_t i = 0; i != deviceQueueCreateInfos.size(); ++i)
 		{
 			deviceQueueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -285,11 +365,18 @@ void Renderer::Init()
 		deviceCreateInfo.ppEnabledExtensionNames = enabledDeviceExtensionNames.data();
 		deviceCreateInfo.pEnabledFeatures = &features;
 
-		VK_CHECK_RESULT(vkCreateDevice(physicalDevices[device.physicalDeviceIndex].handle, &deviceCreateInfo, nullptr, &device.handle), device.handle, "vkCreateDevice");
+		VK_CHECK_RESULT(vkCreateDevice(physicalDevices[device.physicalDeviceIndex].handle, &deviceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &device.handle), device.handle, "vkCreateDevice");
+	}
+
+	/// Memory pool
+	{
+		PROFILE_ZONE("Memory pool");
+		memoryPool.Init(device.handle, physicalDevices[device.physicalDeviceIndex].memoryProperties, physicalDevices[device.physicalDeviceIndex].properties.limits.maxMemoryAllocationCount, &memoryTracker);
 	}
 
 	/// Queues
 	{
+		PROFILE_ZONE("Queues");
 		for (size_t i = 0; i != device.queues.size(); ++i)
 		{
 			device.queues[i].handles.resize(device.queues[i].count);
@@ -302,6 +389,7 @@ void Renderer::Init()
 
 	/// Surface properties
 	{
+		PROFILE_ZONE("Surface properties");
 		surface.colorFormat = VkU::GetVkSurfaceFormatKHR(physicalDevices[device.physicalDeviceIndex].handle, surface, nullptr);
 		surface.compositeAlpha = VkU::GetVkCompositeAlphaFlagBitsKHR(VkU::GetVkSurfaceCapabilitiesKHR(physicalDevices[device.physicalDeviceIndex].handle, surface.handle), &VkU::preferedCompositeAlphas);
 		surface.presentMode = VkU::GetVkPresentModeKHR(physicalDevices[device.physicalDeviceIndex].handle, surface.handle, &VkU::preferedPresentModes);
@@ -309,17 +397,19 @@ void Renderer::Init()
 
 	/// CommandPool
 	{
+		PROFILE_ZONE("CommandPool");
 		VkCommandPoolCreateInfo commandPoolCreateInfo;
 		commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		commandPoolCreateInfo.pNext = nullptr;
 		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		commandPoolCreateInfo.queueFamilyIndex = device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].queueFamilyIndex;
 
-		VK_CHECK_RESULT(vkCreateCommandPool(device.handle, &commandPoolCreateInfo, nullptr, &commandPool), commandPool, "vkCreateCommandPool");
+		VK_CHECK_RESULT(vkCreateCommandPool(device.handle, &commandPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &commandPool), commandPool, "vkCreateCommandPool");
 	}
 
 	/// Setup command buffer
 	{
+		PROFILE_ZONE("Setup command buffer");
 		VkCommandBufferAllocateInfo commandBufferAllocateInfo;
 		commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		commandBufferAllocateInfo.pNext = nullptr;
@@ -332,16 +422,31 @@ void Renderer::Init()
 
 	/// Setup fence
 	{
+		PROFILE_ZONE("Setup fence");
 		VkFenceCreateInfo fenceCreateInfo;
 		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceCreateInfo.pNext = nullptr;
 		fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		VK_CHECK_RESULT(vkCreateFence(device.handle, &fenceCreateInfo, nullptr, &setupFence), setupFence, "vkCreateFence");
+		VK_CHECK_RESULT(vkCreateFence(device.handle, &fenceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &setupFence), setupFence, "vkCreateFence");
+	}
+
+	/// Worker pool
+	{
+		PROFILE_ZONE("Worker pool");
+		workerPool.Init(workerThreadCount);
+	}
+
+	/// Transfer batch
+	{
+		PROFILE_ZONE("Transfer batch");
+		VkU::Queue& transferQueue = device.queues.size() > TRANSFER_QUEUE_INDEX ? device.queues[TRANSFER_QUEUE_INDEX] : device.queues[GRAPHICS_PRESENT_QUEUE_INDEX];
+		transferBatch = VkU::CreateTransferBatch(device.handle, transferQueue, device.queues[GRAPHICS_PRESENT_QUEUE_INDEX], TRANSFER_BATCH_SLOT_COUNT);
 	}
 
 	/// RenderPass
 	{
+		PROFILE_ZONE("RenderPass");
 		VkAttachmentDescription colorAttachmentDescription;
 		colorAttachmentDescription.flags = 0;
 		colorAttachmentDescription.format = surface.colorFormat.format;
@@ -409,59 +514,29 @@ void Renderer::Init()
 		renderPassCreateInfo.dependencyCount = sizeof(subpassDependencies) / sizeof(VkSubpassDependency);
 		renderPassCreateInfo.pDependencies = subpassDependencies;
 
-		VK_CHECK_RESULT(vkCreateRenderPass(device.handle, &renderPassCreateInfo, nullptr, &renderPass), renderPass, "vkCreateRenderPass");
-	}
-
-	/// DescriptorPool
-	{
-		VkDescriptorPoolSize cameraDescriptorPoolSize;
-		cameraDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		cameraDescriptorPoolSize.descriptorCount = 1;
-
-		VkDescriptorPoolSize modelMatricesDescriptorPoolSize;
-		modelMatricesDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		modelMatricesDescriptorPoolSize.descriptorCount = 1;
-
-		VkDescriptorPoolSize pointLightDescriptorPoolSize;
-		pointLightDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		pointLightDescriptorPoolSize.descriptorCount = 1;
-
-		VkDescriptorPoolSize textureDescriptorPoolSize;
-		textureDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		textureDescriptorPoolSize.descriptorCount = 1;
-
-		VkDescriptorPoolSize descriptorPoolSize[] = { cameraDescriptorPoolSize, modelMatricesDescriptorPoolSize, pointLightDescriptorPoolSize, textureDescriptorPoolSize };
-
-		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo;
-		descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		descriptorPoolCreateInfo.pNext = nullptr;
-		descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-		descriptorPoolCreateInfo.maxSets = 1;
-		descriptorPoolCreateInfo.poolSizeCount = sizeof(descriptorPoolSize) / sizeof(VkDescriptorPoolSize);
-		descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSize;
-
-		VK_CHECK_RESULT(vkCreateDescriptorPool(device.handle, &descriptorPoolCreateInfo, nullptr, &descriptorPool), descriptorPool, "vkCreateDescriptorPool");
+		VK_CHECK_RESULT(vkCreateRenderPass(device.handle, &renderPassCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &renderPass), renderPass, "vkCreateRenderPass");
 	}
 
 	/// descriptorSet Layout
 	{
+		PROFILE_ZONE("descriptorSet Layout");
 		VkDescriptorSetLayoutBinding cameraDescriptorSetLayoutBinding;
 		cameraDescriptorSetLayoutBinding.binding = 0;
-		cameraDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		cameraDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		cameraDescriptorSetLayoutBinding.descriptorCount = 1;
 		cameraDescriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		cameraDescriptorSetLayoutBinding.pImmutableSamplers = nullptr;
 
 		VkDescriptorSetLayoutBinding modelMatricesDescriptorSetLayoutBinding;
 		modelMatricesDescriptorSetLayoutBinding.binding = 1;
-		modelMatricesDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		modelMatricesDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 		modelMatricesDescriptorSetLayoutBinding.descriptorCount = 1;
 		modelMatricesDescriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		modelMatricesDescriptorSetLayoutBinding.pImmutableSamplers = nullptr;
 
 		VkDescriptorSetLayoutBinding pointLightDescriptorSetLayoutBinding;
 		pointLightDescriptorSetLayoutBinding.binding = 2;
-		pointLightDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		pointLightDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		pointLightDescriptorSetLayoutBinding.descriptorCount = 1;
 		pointLightDescriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		pointLightDescriptorSetLayoutBinding.pImmutableSamplers = nullptr;
@@ -482,23 +557,12 @@ void Renderer::Init()
 		descriptorSetLayoutCreateInfo.bindingCount = sizeof(descriptorSetLayoutBinding) / sizeof(VkDescriptorSetLayoutBinding);
 		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBinding;
 
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.handle, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayout), descriptorSetLayout, "vkCreateDescriptorSetLayout");
-	}
-
-	/// DescriptorSet
-	{
-		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
-		descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocateInfo.pNext = nullptr;
-		descriptorSetAllocateInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocateInfo.descriptorSetCount = 1;
-		descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
-
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device.handle, &descriptorSetAllocateInfo, &descriptorSet), descriptorSet, "vkAllocateDescriptorSets");
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.handle, &descriptorSetLayoutCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &descriptorSetLayout), descriptorSetLayout, "vkCreateDescriptorSetLayout");
 	}
 
 	/// Sampler
 	{
+		PROFILE_ZONE("Sampler");
 		VkSamplerCreateInfo samplerCreateInfo;
 		samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 		samplerCreateInfo.pNext = nullptr;
@@ -515,17 +579,24 @@ void Renderer::Init()
 		samplerCreateInfo.compareEnable = VK_FALSE;
 		samplerCreateInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 		samplerCreateInfo.minLod = 0.0f;
+#ifdef TEXTURE_MIPMAPS
+		// the last level of the largest possible image, smaller images clamp to their own
+		uint32_t maxImageDimension = physicalDevices[device.physicalDeviceIndex].properties.limits.maxImageDimension2D;
+		samplerCreateInfo.maxLod = (float)(VkU::GetMipLevelCount(maxImageDimension, maxImageDimension) - 1);
+#else
 		samplerCreateInfo.maxLod = 0.0f;
+#endif
 		samplerCreateInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 		samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
 
-		VK_CHECK_RESULT(vkCreateSampler(device.handle, &samplerCreateInfo, nullptr, &sampler), sampler, "vkCreateSampler");
+		VK_CHECK_RESULT(vkCreateSampler(device.handle, &samplerCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &sampler), sampler, "vkCreateSampler");
 	}
 
 	/// Swapchain
 	uint32_t targetSwapchainImageCount = 3;
 	bool useDepthBuffer = true;
 	{
+		PROFILE_ZONE("Swapchain");
 		// swapchain
 		{
 			swapchain.extent.width = width;
@@ -567,7 +638,7 @@ void Renderer::Init()
 			swapchainCreateInfoKHR.clipped = VK_TRUE;
 			swapchainCreateInfoKHR.oldSwapchain = VK_NULL_HANDLE;
 
-			VK_CHECK_RESULT(vkCreateSwapchainKHR(device.handle, &swapchainCreateInfoKHR, nullptr, &swapchain.handle), swapchain.handle, "vkCreateSwapchainKHR");
+			VK_CHECK_RESULT(vkCreateSwapchainKHR(device.handle, &swapchainCreateInfoKHR, memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN), &swapchain.handle), swapchain.handle, "vkCreateSwapchainKHR");
 		}
 
 		// image
@@ -601,14 +672,14 @@ void Renderer::Init()
 			for (size_t i = 0; i != swapchain.views.size(); ++i)
 			{
 				imageViewCreateInfo.image = swapchain.images[i];
-				VK_CHECK_RESULT(vkCreateImageView(device.handle, &imageViewCreateInfo, nullptr, &swapchain.views[i]), swapchain.views[i], "vkCreateImageView");
+				VK_CHECK_RESULT(vkCreateImageView(device.handle, &imageViewCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN), &swapchain.views[i]), swapchain.views[i], "vkCreateImageView");
 			}
 		}
 
 		// Depth Image
 		{
 			depthImage.handle = VK_NULL_HANDLE;
-			depthImage.memory = VK_NULL_HANDLE;
+			depthImage.memory = {};
 			depthImage.view = VK_NULL_HANDLE;
 
 			if (useDepthBuffer)
@@ -634,7 +705,7 @@ void Renderer::Init()
 						imageCreateInfo.pQueueFamilyIndices = nullptr;
 						imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
 
-						VK_CHECK_RESULT(vkCreateImage(device.handle, &imageCreateInfo, nullptr, &depthImage.handle), depthImage.handle, "vkCreateImage");
+						VK_CHECK_RESULT(vkCreateImage(device.handle, &imageCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_DEPTH), &depthImage.handle), depthImage.handle, "vkCreateImage");
 					}
 
 					// memory
@@ -642,14 +713,9 @@ void Renderer::Init()
 						VkMemoryRequirements memoryRequirements;
 						vkGetImageMemoryRequirements(device.handle, depthImage.handle, &memoryRequirements);
 
-						VkMemoryAllocateInfo memoryAllocateInfo;
-						memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-						memoryAllocateInfo.pNext = nullptr;
-						memoryAllocateInfo.allocationSize = memoryRequirements.size;
-						memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, physicalDevices[device.physicalDeviceIndex], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-						VK_CHECK_RESULT(vkAllocateMemory(device.handle, &memoryAllocateInfo, nullptr, &depthImage.memory), depthImage.memory, "vkAllocateMemory");
+						VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, physicalDevices[device.physicalDeviceIndex], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), MemoryTracker::CATEGORY_DEPTH, false, depthImage.memory), depthImage.memory.handle, "MemoryPool::Allocate");
 
-						VK_CHECK_RESULT(vkBindImageMemory(device.handle, depthImage.handle, depthImage.memory, 0), "????????????????", "vkBindImageMemory");
+						VK_CHECK_RESULT(vkBindImageMemory(device.handle, depthImage.handle, depthImage.memory.handle, depthImage.memory.offset), "????????????????", "vkBindImageMemory");
 					}
 
 					// view
@@ -671,7 +737,7 @@ void Renderer::Init()
 						imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
 						imageViewCreateInfo.subresourceRange.levelCount = 1;
 
-						VK_CHECK_RESULT(vkCreateImageView(device.handle, &imageViewCreateInfo, nullptr, &depthImage.view), depthImage.view, "vkCreateImageView");
+						VK_CHECK_RESULT(vkCreateImageView(device.handle, &imageViewCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_DEPTH), &depthImage.view), depthImage.view, "vkCreateImageView");
 					}
 				}
 
@@ -758,24 +824,74 @@ void Renderer::Init()
 					framebufferCreateInfo.attachmentCount = (uint32_t)attachments.size();
 					framebufferCreateInfo.pAttachments = attachments.data();
 
-					VK_CHECK_RESULT(vkCreateFramebuffer(device.handle, &framebufferCreateInfo, nullptr, &swapchain.framebuffers[i]), swapchain.framebuffers[i], "vkCreateFramebuffer");
+					VK_CHECK_RESULT(vkCreateFramebuffer(device.handle, &framebufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN), &swapchain.framebuffers[i]), swapchain.framebuffers[i], "vkCreateFramebuffer");
 				}
 			}}
 	}
 
+	/// DescriptorPool
+	{
+		PROFILE_ZONE("DescriptorPool");
+		// the set in use plus one replaced set per swapchain image that a frame in flight may still read
+		uint32_t descriptorSetCapacity = (uint32_t)swapchain.images.size() + 1;
+
+		VkDescriptorPoolSize cameraDescriptorPoolSize;
+		cameraDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		cameraDescriptorPoolSize.descriptorCount = descriptorSetCapacity;
+
+		VkDescriptorPoolSize modelMatricesDescriptorPoolSize;
+		modelMatricesDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		modelMatricesDescriptorPoolSize.descriptorCount = descriptorSetCapacity;
+
+		VkDescriptorPoolSize pointLightDescriptorPoolSize;
+		pointLightDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		pointLightDescriptorPoolSize.descriptorCount = descriptorSetCapacity;
+
+		VkDescriptorPoolSize textureDescriptorPoolSize;
+		textureDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		textureDescriptorPoolSize.descriptorCount = descriptorSetCapacity;
+
+		VkDescriptorPoolSize descriptorPoolSize[] = { cameraDescriptorPoolSize, modelMatricesDescriptorPoolSize, pointLightDescriptorPoolSize, textureDescriptorPoolSize };
+
+		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo;
+		descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolCreateInfo.pNext = nullptr;
+		descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		descriptorPoolCreateInfo.maxSets = descriptorSetCapacity;
+		descriptorPoolCreateInfo.poolSizeCount = sizeof(descriptorPoolSize) / sizeof(VkDescriptorPoolSize);
+		descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSize;
+
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device.handle, &descriptorPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &descriptorPool), descriptorPool, "vkCreateDescriptorPool");
+	}
+
+	/// DescriptorSet
+	{
+		PROFILE_ZONE("DescriptorSet");
+		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
+		descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorSetAllocateInfo.pNext = nullptr;
+		descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+		descriptorSetAllocateInfo.descriptorSetCount = 1;
+		descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device.handle, &descriptorSetAllocateInfo, &descriptorSet), descriptorSet, "vkAllocateDescriptorSets");
+	}
+
 	/// Semaphore
 	{{
+		PROFILE_ZONE("Semaphore");
 			VkSemaphoreCreateInfo semaphoreCreateInfo;
 			semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 			semaphoreCreateInfo.pNext = nullptr;
 			semaphoreCreateInfo.flags = VK_RESERVED_FOR_FUTURE_USE;
 
-			VK_CHECK_RESULT(vkCreateSemaphore(device.handle, &semaphoreCreateInfo, nullptr, &semaphoreImageAvailable), semaphoreImageAvailable, "vkCreateSemaphore");
-			VK_CHECK_RESULT(vkCreateSemaphore(device.handle, &semaphoreCreateInfo, nullptr, &semaphoreRenderDone), semaphoreRenderDone, "vkCreateSemaphore");
+			VK_CHECK_RESULT(vkCreateSemaphore(device.handle, &semaphoreCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &semaphoreImageAvailable), semaphoreImageAvailable, "vkCreateSemaphore");
+			VK_CHECK_RESULT(vkCreateSemaphore(device.handle, &semaphoreCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &semaphoreRenderDone), semaphoreRenderDone, "vkCreateSemaphore");
 		}}
 
 	/// render command buffer
 	{
+		PROFILE_ZONE("render command buffer");
 		renderCommandBuffers.resize(swapchain.framebuffers.size());
 
 		VkCommandBufferAllocateInfo commandBufferAllocateInfo;
@@ -790,6 +906,7 @@ void Renderer::Init()
 
 	/// render fences
 	{
+		PROFILE_ZONE("render fences");
 		renderFences.resize(renderCommandBuffers.size());
 
 		VkFenceCreateInfo fenceCreateInfo;
@@ -799,199 +916,170 @@ void Renderer::Init()
 
 		for (size_t i = 0; i != renderFences.size(); ++i)
 		{
-			VK_CHECK_RESULT(vkCreateFence(device.handle, &fenceCreateInfo, nullptr, &renderFences[i]), renderFences[i], "vkCreateFence");
+			VK_CHECK_RESULT(vkCreateFence(device.handle, &fenceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &renderFences[i]), renderFences[i], "vkCreateFence");
+		}
+	}
+
+	/// query pools
+	{
+		PROFILE_ZONE("query pools");
+		uint32_t timestampValidBits = physicalDevices[device.physicalDeviceIndex].queueFamilyProperties[device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].queueFamilyIndex].timestampValidBits;
+		timestampsSupported = timestampValidBits != 0;
+		timestampMask = timestampValidBits >= 64 ? ~0ULL : (1ULL << timestampValidBits) - 1;
+#ifdef GPU_PIPELINE_STATISTICS_QUERY
+		pipelineStatisticsSupported = physicalDevices[device.physicalDeviceIndex].features.pipelineStatisticsQuery;
+#else
+		pipelineStatisticsSupported = VK_FALSE;
+#endif
+
+#if _DEBUG
+		if (timestampsSupported == VK_FALSE)
+			logger << "WARNING: The graphics queue does not support timestamps, GPU timings are disabled.\n";
+		if (pipelineStatisticsSupported == VK_FALSE)
+			logger << "WARNING: Pipeline statistics queries are disabled.\n";
+#endif
+
+		frameQueries.resize(renderCommandBuffers.size());
+		for (size_t i = 0; i != frameQueries.size(); ++i)
+		{
+			frameQueries[i].timestamps = VK_NULL_HANDLE;
+			frameQueries[i].pipelineStatistics = VK_NULL_HANDLE;
+			frameQueries[i].pending = VK_FALSE;
+			frameQueries[i].submitTime = 0;
+
+			VkQueryPoolCreateInfo queryPoolCreateInfo;
+			queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCreateInfo.pNext = nullptr;
+			queryPoolCreateInfo.flags = VK_RESERVED_FOR_FUTURE_USE;
+
+			if (timestampsSupported == VK_TRUE)
+			{
+				queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+				queryPoolCreateInfo.queryCount = GPU_TIMESTAMP_COUNT;
+				queryPoolCreateInfo.pipelineStatistics = 0;
+				VK_CHECK_RESULT(vkCreateQueryPool(device.handle, &queryPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &frameQueries[i].timestamps), frameQueries[i].timestamps, "vkCreateQueryPool");
+			}
+			if (pipelineStatisticsSupported == VK_TRUE)
+			{
+				queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+				queryPoolCreateInfo.queryCount = 1;
+				queryPoolCreateInfo.pipelineStatistics = GPU_PIPELINE_STATISTICS;
+				VK_CHECK_RESULT(vkCreateQueryPool(device.handle, &queryPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &frameQueries[i].pipelineStatistics), frameQueries[i].pipelineStatistics, "vkCreateQueryPool");
+			}
 		}
 	}
 }
 void Renderer::Load(std::vector<ShaderProperties> _shaderModulesProperties, std::vector<const char*> _modelNames, std::vector<const char*> _imageNames)
 {
+	PROFILE_ZONE("Renderer::Load");
+
 	maxGpuModelMatrixCount = 64;
 	maxGpuPointLightCount = 4;
 
+	// imported and decoded on the workers while the uniform buffers are created here
+	std::vector<VkU::Meshes> rmeshes;
+	ImportModels(workerPool, _modelNames, rmeshes);
+	std::vector<VkU::ImageData> images;
+	DecodeImages(workerPool, _imageNames, images);
+
 	/// uniforBuffers
 	{
-		// viewProjection
-		{
-			viewProjectionBuffer = VkU::CreateUniformBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(viewProjection));
-			viewProjectionStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(viewProjection));
-		}
-
+		PROFILE_ZONE("uniformBuffers");
 		// model matrices
 		{
-			modelMatrices.resize(maxGpuModelMatrixCount);
-			modelMatrices[1][3][0] = 3.0f;
-			modelMatrices[1][3][1] = 3.0f;
-			modelMatricesBuffer = VkU::CreateUniformBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(glm::mat4) * maxGpuModelMatrixCount);
-			modelMatricesStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(glm::mat4) * maxGpuModelMatrixCount);
+			modelMatrices.Resize(maxGpuModelMatrixCount, (uint32_t)renderFences.size());
+			modelMatrices.Modify(1)[3][0] = 3.0f;
+			modelMatrices.Modify(1)[3][1] = 3.0f;
+			modelMeshes.resize(maxGpuModelMatrixCount, 0);
+			modelCount = 2;
+
+			CreateModelMatricesRing();
+			retiredBuffers.resize(renderFences.size());
+			retiredDescriptorSets.resize(renderFences.size());
 		}
 
 		// point lights
 		{
-			pointLights.resize(maxGpuPointLightCount);
-			pointLights[0].position = {10.0f, 10.0f, 0.0f};
-			pointLights[0].padding = 3.0f;
-			pointLights[0].color = {0.0f, 0.0f, 0.0f};
-			pointLights[0].strenght = 0.0f;
-
-			pointLights[1].position = {-10.0f, 10.0f, 0.0f};
-			pointLights[1].padding = 11.0f;
-			pointLights[1].color = {1.0f, 1.0f, 1.0f};
-			pointLights[1].strenght = 0.0f;
+			pointLights.Resize(maxGpuPointLightCount, (uint32_t)renderFences.size());
+			VkU::PointLight* lights = pointLights.Modify(0, pointLights.Size());
+			lights[0].position = {10.0f, 10.0f, 0.0f};
+			lights[0].padding = 3.0f;
+			lights[0].color = {0.0f, 0.0f, 0.0f};
+			lights[0].strenght = 0.0f;
+
+			lights[1].position = {-10.0f, 10.0f, 0.0f};
+			lights[1].padding = 11.0f;
+			lights[1].color = {1.0f, 1.0f, 1.0f};
+			lights[1].strenght = 0.0f;
+
+			lights[2].position = {10.0f, -10.0f, 0.0f};
+			lights[2].padding = 19.0f;
+			lights[2].color = {0.0f, 0.0f, 0.0f};
+			lights[2].strenght = 0.0f;
+
+			lights[3].position = {-10.0f, -10.0f, 0.0f};
+			lights[3].padding = 27.0f;
+			lights[3].color = {0.0f, 0.0f, 0.0f};
+			lights[3].strenght = 0.0f;
+		}
 
-			pointLights[2].position = {10.0f, -10.0f, 0.0f};
-			pointLights[2].padding = 19.0f;
-			pointLights[2].color = {0.0f, 0.0f, 0.0f};
-			pointLights[2].strenght = 0.0f;
+		// uniform ring
+		{
+			VkDeviceSize alignment = physicalDevices[device.physicalDeviceIndex].properties.limits.minUniformBufferOffsetAlignment;
 
-			pointLights[3].position = {-10.0f, -10.0f, 0.0f};
-			pointLights[3].padding = 27.0f;
-			pointLights[3].color = {0.0f, 0.0f, 0.0f};
-			pointLights[3].strenght = 0.0f;
+			viewProjectionOffset = 0;
+			pointLightsOffset = (viewProjectionOffset + sizeof(viewProjection) + alignment - 1) & ~(alignment - 1);
+			uniformRingSlotSize = (pointLightsOffset + sizeof(VkU::PointLight) * maxGpuPointLightCount + alignment - 1) & ~(alignment - 1);
 
-			pointLightsBuffer = VkU::CreateUniformBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(VkU::PointLight) * pointLights.size());
-			pointLightsStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(VkU::PointLight) * pointLights.size());
+			uniformRing = VkU::CreateHostUniformBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], uniformRingSlotSize * renderFences.size(), hostWriteMemoryPropertyFlags);
 		}
 	}
 
 	/// textures
 	{{
+		PROFILE_ZONE("textures");
+		{
+			PROFILE_ZONE("wait for import and decode");
+			workerPool.Wait();
+		}
+
+		// staged one after the other into the batch's blocks, then copied with one barrier before and one after all of them
 		imageBuffers.resize(_imageNames.size());
+		std::vector<VkU::ImageCopy> imageCopies(_imageNames.size());
 		for (size_t i = 0; i != _imageNames.size(); ++i)
 		{
-			
-			uint32_t width, height;
-			uint8_t channelCount, bytesPerChannel;
-			void* data = nullptr;
+			VkU::ImageData& image = images[i];
+			uint8_t texelSize = image.channelCount * image.bytesPerChannel;
 			VkFormat imageFormat;
 			VkDeviceSize size;
 
 			// create
 			{
-				// gather data
-				VkU::LoadImageTGA(_imageNames[i], width, height, channelCount, bytesPerChannel, data);
+				size = VkU::GetMipLevelOffset(image.width, image.height, texelSize, image.mipLevelCount);
 
-				size = width * height * channelCount * bytesPerChannel;
-
-				if (channelCount == 3)
+				if (image.channelCount == 3)
 					imageFormat = VK_FORMAT_B8G8R8_UNORM;
-				else if (channelCount == 4)
+				else if (image.channelCount == 4)
 					imageFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
 				// image
-				VkU::CreateSampledImage(device.handle, physicalDevices[device.physicalDeviceIndex], imageBuffers[i], imageFormat, { width, height, 1 });
+				VkU::CreateSampledImage(device.handle, physicalDevices[device.physicalDeviceIndex], imageBuffers[i], imageFormat, { image.width, image.height, 1 }, image.mipLevelCount);
 				// view
-				VkU::CreateColorView(device.handle, imageBuffers[i], imageFormat);
+				VkU::CreateColorView(device.handle, imageBuffers[i], imageFormat, image.mipLevelCount);
 			}
 
-			VkU::Image stagingImage;
 			// staging
 			{
-				VkU::CreateStagingImage(device.handle, physicalDevices[device.physicalDeviceIndex], stagingImage, imageFormat, { width, height, 1 });
-				VkU::FillStagingColorImage(device.handle, stagingImage, width, height, size, data);
-			}
-
-			// transition
-			{
-				VkCommandBufferBeginInfo commandBufferBeginInfo;
-				commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-				commandBufferBeginInfo.pNext = nullptr;
-				commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-				commandBufferBeginInfo.pInheritanceInfo = nullptr;
-				VK_CHECK_RESULT(vkWaitForFences(device.handle, 1, &setupFence, VK_TRUE, -1), 0, "vkWaitForFences");
-				VK_CHECK_RESULT(vkBeginCommandBuffer(setupCommandBuffer, &commandBufferBeginInfo), 0, "vkBeginCommandBuffer");
-
-				// transfer texture to destination
-				VkImageMemoryBarrier imageMemoryBarrier;
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.pNext = nullptr;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				imageMemoryBarrier.image = imageBuffers[i].handle;
-				imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-				imageMemoryBarrier.subresourceRange.levelCount = 1;
-				imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-				imageMemoryBarrier.subresourceRange.layerCount = 1;
-				vkCmdPipelineBarrier(setupCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-				// transfer staging to source
-				VkImageMemoryBarrier stagingImageMemoryBarrier;
-				stagingImageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				stagingImageMemoryBarrier.pNext = nullptr;
-				stagingImageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-				stagingImageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				stagingImageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-				stagingImageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				stagingImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				stagingImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				stagingImageMemoryBarrier.image = stagingImage.handle;
-				stagingImageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				stagingImageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-				stagingImageMemoryBarrier.subresourceRange.levelCount = 1;
-				stagingImageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-				stagingImageMemoryBarrier.subresourceRange.layerCount = 1;
-				vkCmdPipelineBarrier(setupCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &stagingImageMemoryBarrier);
-
-				// copy data 
-				VkImageSubresourceLayers imageSubresourceLayers;
-				imageSubresourceLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageSubresourceLayers.mipLevel = 0;
-				imageSubresourceLayers.baseArrayLayer = 0;
-				imageSubresourceLayers.layerCount = 1;
-
-				VkImageCopy imageCopy;
-				imageCopy.srcSubresource = imageSubresourceLayers;
-				imageCopy.srcOffset = { 0, 0, 0 };
-				imageCopy.dstSubresource = imageSubresourceLayers;
-				imageCopy.dstOffset = { 0, 0, 0 };
-				imageCopy.extent.width = width;
-				imageCopy.extent.height = height;
-				imageCopy.extent.depth = 1;
-
-				vkCmdCopyImage(setupCommandBuffer, stagingImage.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageBuffers[i].handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopy);
-
-				// transfer texture to shader readable layout
-				VkImageMemoryBarrier finalMemoryBarrier;
-				finalMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				finalMemoryBarrier.pNext = nullptr;
-				finalMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				finalMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-				finalMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				finalMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				finalMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				finalMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				finalMemoryBarrier.image = imageBuffers[i].handle;
-				finalMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				finalMemoryBarrier.subresourceRange.baseMipLevel = 0;
-				finalMemoryBarrier.subresourceRange.levelCount = 1;
-				finalMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-				finalMemoryBarrier.subresourceRange.layerCount = 1;
-				vkCmdPipelineBarrier(setupCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &finalMemoryBarrier);
-
-				VK_CHECK_RESULT(vkEndCommandBuffer(setupCommandBuffer), 0, "vkEndCommandBuffer");
-
-				VkSubmitInfo submitInfo;
-				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-				submitInfo.pNext = nullptr;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = &setupCommandBuffer;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-				VK_CHECK_RESULT(vkQueueSubmit(device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0], 1, &submitInfo, VK_NULL_HANDLE), 0, "vkQueueSubmit");
-				VK_CHECK_RESULT(vkQueueWaitIdle(device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0]), 0, "vkQueueWaitIdle");
+				// buffer offsets of image copies are multiples of 4 and of the texel size
+				VkU::StagingRegion stagingRegion = VkU::AllocateTransferStaging(device.handle, physicalDevices[device.physicalDeviceIndex], transferBatch, size, texelSize * 4);
+				memcpy(stagingRegion.data, image.data, size);
+				imageCopies[i] = { stagingRegion.buffer, stagingRegion.offset, imageBuffers[i], { image.width, image.height, 1 }, texelSize, image.mipLevelCount };
 			}
 
-			vkDestroyImage(device.handle, stagingImage.handle, nullptr);
-			vkFreeMemory(device.handle, stagingImage.memory, nullptr);
-			delete[] data;
+			delete[] image.data;
 		}
+
+		VkU::EnqueueBufferToImageCopies(device.handle, transferBatch, (uint32_t)imageCopies.size(), imageCopies.data());
 	}}
 
 	//std::vector<VkU::VertexPosUV> mesh = 
@@ -1012,51 +1100,71 @@ void Renderer::Load(std::vector<ShaderProperties> _shaderModulesProperties, std:
 	//	4, 5, 6, 6, 7, 4,
 	//};
 
-	VkU::Meshes rmesh;
-	VkU::LoadModel(_modelNames[0], rmesh, (aiPostProcessSteps)(aiProcess_GenNormals | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices));
-
-	/// vertexBuffer / indexBuffer
-	{
-		//VkDeviceSize vertexBufferSize = sizeof(VkU::VertexPosUV) * mesh.size();
-		//VkDeviceSize indexBufferSize = sizeof(VkU::VertexPosUV) * mesh.size();
-		//
-		//vertexBuffer = VkU::CreateVertexBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], vertexBufferSize);
-		//VkU::Buffer vertexStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], vertexBufferSize);
-		//VkU::FillStagingBuffer(device.handle, vertexStagingBuffer, vertexBufferSize, mesh.data());
-		//VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, vertexStagingBuffer, vertexBuffer, vertexBufferSize);
-		//VkU::WaitFence(device.handle, 1, &setupFence, VK_TRUE, -1);
-		//VkU::DestroyBuffer(device.handle, vertexStagingBuffer);
-		//
-		//indexBuffer = VkU::CreateIndexBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], indexBufferSize);
-		//VkU::Buffer indexStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], indexBufferSize);
-		//VkU::FillStagingBuffer(device.handle, indexStagingBuffer, indexBufferSize, indices.data());
-		//VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, indexStagingBuffer, indexBuffer, indexBufferSize);
-		//VkU::WaitFence(device.handle, 1, &setupFence, VK_TRUE, -1);
-		//VkU::DestroyBuffer(device.handle, indexStagingBuffer);
-
-		VkDeviceSize vertexBufferSize = rmesh.vertexSize;
-		VkDeviceSize indexBufferSize = rmesh.indexSize;
-		
-		vertexBuffer = VkU::CreateVertexBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], vertexBufferSize);
-		VkU::Buffer vertexStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], vertexBufferSize);
-		VkU::FillStagingBuffer(device.handle, vertexStagingBuffer, vertexBufferSize, rmesh.vertexData);
-		VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, vertexStagingBuffer, vertexBuffer, vertexBufferSize);
-		VkU::WaitFence(device.handle, 1, &setupFence, VK_TRUE, -1);
-		VkU::DestroyBuffer(device.handle, vertexStagingBuffer);
-		
-		indexBuffer = VkU::CreateIndexBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], indexBufferSize);
-		VkU::Buffer indexStagingBuffer = VkU::CreateStagingBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], indexBufferSize);
-		VkU::FillStagingBuffer(device.handle, indexStagingBuffer, indexBufferSize, rmesh.indexData);
-		VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, indexStagingBuffer, indexBuffer, indexBufferSize);
-		VkU::WaitFence(device.handle, 1, &setupFence, VK_TRUE, -1);
-		VkU::DestroyBuffer(device.handle, indexStagingBuffer);
-	}
-
-	delete[] rmesh.indexData;
-	delete[] rmesh.vertexData;
+	/// geometry
+	{
+		PROFILE_ZONE("geometry");
+		geometryBuffer = VkU::CreateGeometryBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], sizeof(VkU::VertexPosUvNormTanBitan), GEOMETRY_VERTEX_CAPACITY, GEOMETRY_INDEX_CAPACITY, directUpload ? hostWriteMemoryPropertyFlags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// placed in list order, the offsets do not depend on which import finished first
+		meshes.resize(_modelNames.size());
+		for (size_t i = 0; i != _modelNames.size(); ++i)
+		{
+			VkU::Meshes& rmesh = rmeshes[i];
+
+			// a mesh that could not be placed draws nothing
+			meshes[i] = {};
+			uint32_t vertexCount = (uint32_t)(rmesh.vertexSize / geometryBuffer.vertexStride);
+			uint32_t indexCount = (uint32_t)(rmesh.indexSize / sizeof(uint32_t));
+			if (rmesh.vertexStride != geometryBuffer.vertexStride)
+			{
+#if _DEBUG
+				logger << "ERROR: MODEL \"" << _modelNames[i] << "\" has a vertex stride of " << rmesh.vertexStride << " bytes, the pipeline expects " << geometryBuffer.vertexStride << ".\n";
+#endif
+			}
+			else if (VkU::AllocateMesh(geometryBuffer, vertexCount, indexCount, meshes[i]) == false)
+			{
+#if _DEBUG
+				logger << "ERROR: MODEL \"" << _modelNames[i] << "\" does not fit into the geometry buffer.\n";
+#endif
+			}
+			else
+			{
+				VkDeviceSize vertexOffset = (VkDeviceSize)meshes[i].vertexOffset * geometryBuffer.vertexStride;
+				VkDeviceSize indexOffset = (VkDeviceSize)meshes[i].firstIndex * sizeof(uint32_t);
+
+				// the geometry buffer is host visible, nothing to stage or copy
+				if (directUpload)
+				{
+					memcpy(geometryBuffer.vertexBuffer.memory.mapped + vertexOffset, rmesh.vertexData, rmesh.vertexSize);
+					memcpy(geometryBuffer.indexBuffer.memory.mapped + indexOffset, rmesh.indexData, rmesh.indexSize);
+				}
+				else
+				{
+					VkU::StagingRegion vertexStagingRegion = VkU::AllocateTransferStaging(device.handle, physicalDevices[device.physicalDeviceIndex], transferBatch, rmesh.vertexSize, 16);
+					memcpy(vertexStagingRegion.data, rmesh.vertexData, rmesh.vertexSize);
+					VkU::EnqueueBufferCopy(device.handle, transferBatch, vertexStagingRegion.buffer, vertexStagingRegion.offset, geometryBuffer.vertexBuffer, vertexOffset, rmesh.vertexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+					VkU::StagingRegion indexStagingRegion = VkU::AllocateTransferStaging(device.handle, physicalDevices[device.physicalDeviceIndex], transferBatch, rmesh.indexSize, 16);
+					memcpy(indexStagingRegion.data, rmesh.indexData, rmesh.indexSize);
+					VkU::EnqueueBufferCopy(device.handle, transferBatch, indexStagingRegion.buffer, indexStagingRegion.offset, geometryBuffer.indexBuffer, indexOffset, rmesh.indexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+				}
+			}
+
+			delete[] rmesh.indexData;
+			delete[] rmesh.vertexData;
+		}
+	}
+
+	/// transfers
+	{
+		PROFILE_ZONE("transfers");
+		uint64_t ticket = VkU::FlushTransferBatch(transferBatch);
+		VkU::WaitTransferTicket(device.handle, transferBatch, ticket);
+	}
 
 	/// shaders modules
 	{
+		PROFILE_ZONE("shaders modules");
 		shaderModules.resize(_shaderModulesProperties.size());
 		for (size_t i = 0; i != _shaderModulesProperties.size(); ++i)
 		{
@@ -1073,7 +1181,7 @@ void Renderer::Load(std::vector<ShaderProperties> _shaderModulesProperties, std:
 				shaderModuleCreateInfo.flags = VK_RESERVED_FOR_FUTURE_USE;
 				shaderModuleCreateInfo.codeSize = fileSize;
 				shaderModuleCreateInfo.pCode = (uint32_t*)buffer;
-				VK_CHECK_RESULT(vkCreateShaderModule(device.handle, &shaderModuleCreateInfo, nullptr, &shaderModules[i].handle), shaderModules[i].handle, "vkCreateShaderModule");
+				VK_CHECK_RESULT(vkCreateShaderModule(device.handle, &shaderModuleCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &shaderModules[i].handle), shaderModules[i].handle, "vkCreateShaderModule");
 
 				delete[] buffer;
 
@@ -1085,8 +1193,11 @@ void Renderer::Load(std::vector<ShaderProperties> _shaderModulesProperties, std:
 }
 void Renderer::Setup()
 {
+	PROFILE_ZONE("Renderer::Setup");
+
 	/// pipeline layout
 	{
+		PROFILE_ZONE("pipeline layout");
 		VkPushConstantRange vertexShaderPushConstantRange;
 		vertexShaderPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		vertexShaderPushConstantRange.offset = 0;
@@ -1108,11 +1219,12 @@ void Renderer::Setup()
 		pipelineLayoutCreateInfo.pushConstantRangeCount = sizeof(pushConstantRanges) / sizeof(VkPushConstantRange);;
 		pipelineLayoutCreateInfo.pPushConstantRanges = pushConstantRanges;
 
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device.handle, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout), pipelineLayout, "vkCreatePipelineLayout");
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device.handle, &pipelineLayoutCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &pipelineLayout), pipelineLayout, "vkCreatePipelineLayout");
 	}
 
 	/// pipeline data
 	{
+		PROFILE_ZONE("pipeline data");
 		// shader stage
 		{
 			pipelineShaderStagesCreateInfos.resize(1);
@@ -1385,15 +1497,17 @@ void Renderer::Setup()
 
 	/// pipeline
 	{{
+		PROFILE_ZONE("pipeline");
 		pipelines.resize(2);
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device.handle, VK_NULL_HANDLE, (uint32_t)graphicsPipelineCreateInfos.size(), graphicsPipelineCreateInfos.data(), nullptr, pipelines.data()), "????????????????", " - vkCreateGraphicsPipelines");
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device.handle, VK_NULL_HANDLE, (uint32_t)graphicsPipelineCreateInfos.size(), graphicsPipelineCreateInfos.data(), memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), pipelines.data()), "????????????????", " - vkCreateGraphicsPipelines");
 	}}
 
 	/// update descriptor set
 	{
+		PROFILE_ZONE("update descriptor set");
 		VkDescriptorBufferInfo cameraDescriptorBufferInfo;
-		cameraDescriptorBufferInfo.buffer = viewProjectionBuffer.handle;
-		cameraDescriptorBufferInfo.offset = 0;
+		cameraDescriptorBufferInfo.buffer = uniformRing.handle;
+		cameraDescriptorBufferInfo.offset = viewProjectionOffset;
 		cameraDescriptorBufferInfo.range = sizeof(viewProjection);
 
 		VkWriteDescriptorSet viewProjectionWriteDescriptorSet;
@@ -1403,15 +1517,15 @@ void Renderer::Setup()
 		viewProjectionWriteDescriptorSet.dstBinding = VIEW_PROJECTION_UNIFORM_BINDING;
 		viewProjectionWriteDescriptorSet.dstArrayElement = 0;
 		viewProjectionWriteDescriptorSet.descriptorCount = 1;
-		viewProjectionWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		viewProjectionWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		viewProjectionWriteDescriptorSet.pImageInfo = nullptr;
 		viewProjectionWriteDescriptorSet.pBufferInfo = &cameraDescriptorBufferInfo;
 		viewProjectionWriteDescriptorSet.pTexelBufferView = nullptr;
 
 		VkDescriptorBufferInfo modelMatricesDescriptorBufferInfo;
-		modelMatricesDescriptorBufferInfo.buffer = modelMatricesBuffer.handle;
+		modelMatricesDescriptorBufferInfo.buffer = modelMatricesRing.handle;
 		modelMatricesDescriptorBufferInfo.offset = 0;
-		modelMatricesDescriptorBufferInfo.range = sizeof(glm::mat4) * modelMatrices.size();
+		modelMatricesDescriptorBufferInfo.range = sizeof(glm::mat4) * maxGpuModelMatrixCount;
 
 		VkWriteDescriptorSet modelMatricesWriteDescriptorSet;
 		modelMatricesWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -1420,15 +1534,15 @@ void Renderer::Setup()
 		modelMatricesWriteDescriptorSet.dstBinding = MODEL_MATRICES_UNIFORM_BINDING;
 		modelMatricesWriteDescriptorSet.dstArrayElement = 0;
 		modelMatricesWriteDescriptorSet.descriptorCount = 1;
-		modelMatricesWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		modelMatricesWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 		modelMatricesWriteDescriptorSet.pImageInfo = nullptr;
 		modelMatricesWriteDescriptorSet.pBufferInfo = &modelMatricesDescriptorBufferInfo;
 		modelMatricesWriteDescriptorSet.pTexelBufferView = nullptr;
 
 		VkDescriptorBufferInfo pointLightsDescriptorBufferInfo;
-		pointLightsDescriptorBufferInfo.buffer = pointLightsBuffer.handle;
-		pointLightsDescriptorBufferInfo.offset = 0;
-		pointLightsDescriptorBufferInfo.range = sizeof(VkU::PointLight) * pointLights.size();
+		pointLightsDescriptorBufferInfo.buffer = uniformRing.handle;
+		pointLightsDescriptorBufferInfo.offset = pointLightsOffset;
+		pointLightsDescriptorBufferInfo.range = sizeof(VkU::PointLight) * pointLights.Size();
 
 		VkWriteDescriptorSet pointLightsWriteDescriptorSet;
 		pointLightsWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -1437,7 +1551,7 @@ void Renderer::Setup()
 		pointLightsWriteDescriptorSet.dstBinding = POINT_LIGHT_UNIFORM_BINDING;
 		pointLightsWriteDescriptorSet.dstArrayElement = 0;
 		pointLightsWriteDescriptorSet.descriptorCount = 1;
-		pointLightsWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		pointLightsWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		pointLightsWriteDescriptorSet.pImageInfo = nullptr;
 		pointLightsWriteDescriptorSet.pBufferInfo = &pointLightsDescriptorBufferInfo;
 		pointLightsWriteDescriptorSet.pTexelBufferView = nullptr;
@@ -1463,11 +1577,17 @@ void Renderer::Setup()
 
 		vkUpdateDescriptorSets(device.handle, sizeof(writeDescriptorSet) / sizeof(VkWriteDescriptorSet), writeDescriptorSet, 0, nullptr);
 	}
+
+	lastTime = Engine::timer.GetTime();
+	lastTitleTime = lastTime;
 }
 void Renderer::Render()
 {
+	PROFILE_ZONE("Renderer::Render");
+
 	// Prepare To Draw
 	{
+		PROFILE_ZONE("Prepare To Draw");
 		// Get Swapchain Image Index
 		VK_CHECK_RESULT(vkWaitForFences(device.handle, 1, &setupFence, VK_TRUE, -1), "????????????????", "vkWaitForFences");
 		VK_CHECK_RESULT(vkResetFences(device.handle, 1, &setupFence), "????????????????", "vkResetFences");
@@ -1481,8 +1601,76 @@ void Renderer::Render()
 		commandBufferBeginInfo.pInheritanceInfo = nullptr;
 		VK_CHECK_RESULT(vkWaitForFences(device.handle, 1, &renderFences[swapchainImageIndex], VK_TRUE, -1), "????????????????", "vkWaitForFences");
 		VK_CHECK_RESULT(vkResetFences(device.handle, 1, &renderFences[swapchainImageIndex]), "????????????????", "vkResetFences");
+
+		// replaced while this image's previous frame could still read them
+		for (size_t i = 0; i != retiredBuffers[swapchainImageIndex].size(); ++i)
+			VkU::DestroyBuffer(device.handle, retiredBuffers[swapchainImageIndex][i]);
+		retiredBuffers[swapchainImageIndex].clear();
+		if (retiredDescriptorSets[swapchainImageIndex].size() != 0)
+			VK_CHECK_RESULT(vkFreeDescriptorSets(device.handle, descriptorPool, (uint32_t)retiredDescriptorSets[swapchainImageIndex].size(), retiredDescriptorSets[swapchainImageIndex].data()), "????????????????", "vkFreeDescriptorSets");
+		retiredDescriptorSets[swapchainImageIndex].clear();
+
+		// AddModel outgrew the storage since the last frame, before Draw binds it
+		if (modelMatrices.Size() != maxGpuModelMatrixCount)
+			GrowModelMatrices();
+
+		// Read back the queries of the last frame that used this image, its fence was just waited on so nothing stalls
+		VkU::FrameQueries& queries = frameQueries[swapchainImageIndex];
+		if (queries.pending == VK_TRUE)
+		{
+			queries.pending = VK_FALSE;
+
+			if (timestampsSupported == VK_TRUE)
+			{
+				uint64_t timestamps[GPU_TIMESTAMP_COUNT];
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device.handle, queries.timestamps, 0, GPU_TIMESTAMP_COUNT, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT), "????????????????", "vkGetQueryPoolResults");
+				if (vkResult == VK_SUCCESS)
+				{
+					// nanoseconds since the render pass began
+					double timestampPeriod = physicalDevices[device.physicalDeviceIndex].properties.limits.timestampPeriod;
+					uint64_t times[GPU_TIMESTAMP_COUNT];
+					for (size_t i = 0; i != GPU_TIMESTAMP_COUNT; ++i)
+						times[i] = (uint64_t)(((timestamps[i] - timestamps[GPU_TIMESTAMP_RENDER_PASS_BEGIN]) & timestampMask) * timestampPeriod);
+
+					gpuStatistics.renderPassTime = times[GPU_TIMESTAMP_RENDER_PASS_END] * 0.000000001;
+					gpuStatistics.drawTimes[0] = (times[GPU_TIMESTAMP_DRAW_0_END] - times[GPU_TIMESTAMP_DRAW_0_BEGIN]) * 0.000000001;
+					gpuStatistics.drawTimes[1] = (times[GPU_TIMESTAMP_DRAW_1_END] - times[GPU_TIMESTAMP_DRAW_0_END]) * 0.000000001;
+					gpuStatistics.drawTimes[2] = (times[GPU_TIMESTAMP_ADDED_MODELS_END] - times[GPU_TIMESTAMP_ADDED_MODELS_BEGIN]) * 0.000000001;
+
+#ifdef PROFILER
+					// GPU and CPU clocks are not correlated, the GPU zones are placed from the CPU submit time
+					Profiler::Get().Add("GPU Render pass", queries.submitTime, queries.submitTime + times[GPU_TIMESTAMP_RENDER_PASS_END], 0, PROFILER_GPU_THREAD_ID);
+					Profiler::Get().Add("GPU Draw 0", queries.submitTime + times[GPU_TIMESTAMP_DRAW_0_BEGIN], queries.submitTime + times[GPU_TIMESTAMP_DRAW_0_END], 1, PROFILER_GPU_THREAD_ID);
+					Profiler::Get().Add("GPU Draw 1", queries.submitTime + times[GPU_TIMESTAMP_DRAW_0_END], queries.submitTime + times[GPU_TIMESTAMP_DRAW_1_END], 1, PROFILER_GPU_THREAD_ID);
+					Profiler::Get().Add("GPU Draw added models", queries.submitTime + times[GPU_TIMESTAMP_ADDED_MODELS_BEGIN], queries.submitTime + times[GPU_TIMESTAMP_ADDED_MODELS_END], 1, PROFILER_GPU_THREAD_ID);
+#endif
+				}
+			}
+
+			if (pipelineStatisticsSupported == VK_TRUE)
+			{
+				// in bit order: vertex invocations, clipping primitives, fragment invocations
+				uint64_t pipelineStatistics[GPU_PIPELINE_STATISTICS_COUNT];
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device.handle, queries.pipelineStatistics, 0, 1, sizeof(pipelineStatistics), pipelineStatistics, sizeof(pipelineStatistics), VK_QUERY_RESULT_64_BIT), "????????????????", "vkGetQueryPoolResults");
+				if (vkResult == VK_SUCCESS)
+				{
+					gpuStatistics.vertexInvocations = pipelineStatistics[0];
+					gpuStatistics.clippingPrimitives = pipelineStatistics[1];
+					gpuStatistics.fragmentInvocations = pipelineStatistics[2];
+				}
+			}
+		}
+
 		VK_CHECK_RESULT(vkBeginCommandBuffer(renderCommandBuffers[swapchainImageIndex], &commandBufferBeginInfo), "????????????????", "vkBeginCommandBuffer");
 
+		if (timestampsSupported == VK_TRUE)
+		{
+			vkCmdResetQueryPool(renderCommandBuffers[swapchainImageIndex], queries.timestamps, 0, GPU_TIMESTAMP_COUNT);
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamps, GPU_TIMESTAMP_RENDER_PASS_BEGIN);
+		}
+		if (pipelineStatisticsSupported == VK_TRUE)
+			vkCmdResetQueryPool(renderCommandBuffers[swapchainImageIndex], queries.pipelineStatistics, 0, 1);
+
 		VkClearValue clearColor[2];
 		clearColor[0].color = { 0.15f, 0.2f, 0.25f, 1.0f };
 		clearColor[1].depthStencil = { 1.0f, 0 };
@@ -1501,6 +1689,7 @@ void Renderer::Render()
 
 	// Draw
 	{
+		PROFILE_ZONE("Draw");
 		struct VertexShaderPushConstantData
 		{
 			uint32_t modelIndex;
@@ -1526,10 +1715,15 @@ void Renderer::Render()
 
 		vkCmdBindPipeline(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0]);
 
-		vkCmdBindVertexBuffers(renderCommandBuffers[swapchainImageIndex], 0, 1, &vertexBuffer.handle, &offset);
-		vkCmdBindIndexBuffer(renderCommandBuffers[swapchainImageIndex], indexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
+		// every mesh lives in the geometry buffer, bound once
+		vkCmdBindVertexBuffers(renderCommandBuffers[swapchainImageIndex], 0, 1, &geometryBuffer.vertexBuffer.handle, &offset);
+		vkCmdBindIndexBuffer(renderCommandBuffers[swapchainImageIndex], geometryBuffer.indexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
 
-		vkCmdBindDescriptorSets(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		// in binding order: viewProjection, model matrices, point lights, all in this image's slots
+		uint32_t uniformRingOffset = (uint32_t)(uniformRingSlotSize * swapchainImageIndex);
+		uint32_t modelMatricesRingOffset = (uint32_t)(modelMatricesSlotSize * swapchainImageIndex);
+		uint32_t dynamicOffsets[] = { uniformRingOffset, modelMatricesRingOffset, uniformRingOffset };
+		vkCmdBindDescriptorSets(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, sizeof(dynamicOffsets) / sizeof(uint32_t), dynamicOffsets);
 		vertexShaderPushConstantData =
 		{
 			0,
@@ -1548,7 +1742,17 @@ void Renderer::Render()
 		};
 		vkCmdPushConstants(renderCommandBuffers[swapchainImageIndex], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vertexShaderPushConstantData), &vertexShaderPushConstantData);
 		vkCmdPushConstants(renderCommandBuffers[swapchainImageIndex], pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 16, sizeof(fragmentShaderPushConstantData), &fragmentShaderPushConstantData);
-		vkCmdDrawIndexed(renderCommandBuffers[swapchainImageIndex], 320*3, 1, 0, 0, 0);
+
+		if (pipelineStatisticsSupported == VK_TRUE)
+			vkCmdBeginQuery(renderCommandBuffers[swapchainImageIndex], frameQueries[swapchainImageIndex].pipelineStatistics, 0, 0);
+		if (timestampsSupported == VK_TRUE)
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_DRAW_0_BEGIN);
+
+		const VkU::Mesh* mesh = &meshes[modelMeshes[0]];
+		vkCmdDrawIndexed(renderCommandBuffers[swapchainImageIndex], mesh->indexCount, 1, mesh->firstIndex, mesh->vertexOffset, 0);
+
+		if (timestampsSupported == VK_TRUE)
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_DRAW_0_END);
 
 		vertexShaderPushConstantData =
 		{
@@ -1558,43 +1762,74 @@ void Renderer::Render()
 			cos(time) * 10,
 		};
 		vkCmdPushConstants(renderCommandBuffers[swapchainImageIndex], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vertexShaderPushConstantData), &vertexShaderPushConstantData);
-		vkCmdDrawIndexed(renderCommandBuffers[swapchainImageIndex], 320 * 3, 1, 0, 0, 0);
+		mesh = &meshes[modelMeshes[1]];
+		vkCmdDrawIndexed(renderCommandBuffers[swapchainImageIndex], mesh->indexCount, 1, mesh->firstIndex, mesh->vertexOffset, 0);
+
+		if (timestampsSupported == VK_TRUE)
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_DRAW_1_END);
+
+		// added models, the matrix index and the mesh range change
+		if (timestampsSupported == VK_TRUE)
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_ADDED_MODELS_BEGIN);
+		for (uint32_t i = 2; i != modelCount; ++i)
+		{
+			vertexShaderPushConstantData.modelIndex = i;
+			vkCmdPushConstants(renderCommandBuffers[swapchainImageIndex], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &vertexShaderPushConstantData.modelIndex);
+			mesh = &meshes[modelMeshes[i]];
+			vkCmdDrawIndexed(renderCommandBuffers[swapchainImageIndex], mesh->indexCount, 1, mesh->firstIndex, mesh->vertexOffset, 0);
+		}
+		if (timestampsSupported == VK_TRUE)
+			vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_ADDED_MODELS_END);
+		if (pipelineStatisticsSupported == VK_TRUE)
+			vkCmdEndQuery(renderCommandBuffers[swapchainImageIndex], frameQueries[swapchainImageIndex].pipelineStatistics, 0);
 	}
 
 	// draw conclusion
 	{{
+		PROFILE_ZONE("draw conclusion");
 			vkCmdEndRenderPass(renderCommandBuffers[swapchainImageIndex]);
+			if (timestampsSupported == VK_TRUE)
+				vkCmdWriteTimestamp(renderCommandBuffers[swapchainImageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries[swapchainImageIndex].timestamps, GPU_TIMESTAMP_RENDER_PASS_END);
 			VK_CHECK_RESULT(vkEndCommandBuffer(renderCommandBuffers[swapchainImageIndex]), "????????????????", "vkEndCommandBuffer");
 	}}
 
 	// Update uniforms
 	{
+		PROFILE_ZONE("Update uniforms");
 		// data
 		//viewProjection[0] = glm::lookAt(glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
 		viewProjection[1] = glm::perspective(glm::radians(45.0f), swapchain.extent.width / (float)swapchain.extent.height, 0.1f, 1000.0f);
 		viewProjection[1][1][1] *= -1;
 
-		// staging
-		VkU::FillStagingBuffer(device.handle, viewProjectionStagingBuffer, sizeof(viewProjection), viewProjection);
-		VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, viewProjectionStagingBuffer, viewProjectionBuffer, sizeof(viewProjection));
+		modelMatrices.Modify(0) = glm::rotate(modelMatrices[0], (float)Engine::deltaTime/5, glm::vec3(0.0f, -1.0f, 0.0f));
 
-		modelMatrices[0] = glm::rotate(modelMatrices[0], (float)Engine::deltaTime/5, glm::vec3(0.0f, -1.0f, 0.0f));
-		VkU::FillStagingBuffer(device.handle, modelMatricesStagingBuffer, sizeof(glm::mat4) * maxGpuModelMatrixCount, modelMatrices.data());
-		VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, modelMatricesStagingBuffer, modelMatricesBuffer, sizeof(glm::mat4) * maxGpuModelMatrixCount);
-
-		VkU::FillStagingBuffer(device.handle, pointLightsStagingBuffer, sizeof(VkU::PointLight) * pointLights.size(), pointLights.data());
-		VkU::TransferStagingBuffer(device, setupCommandBuffer, setupFence, pointLightsStagingBuffer, pointLightsBuffer, sizeof(VkU::PointLight) * pointLights.size());
+		// straight into this image's slot, its fence was waited on and the coherent writes are visible at submit
+		// the arrays only write what changed since this slot was last written
+		uint8_t* slot = uniformRing.memory.mapped + uniformRingSlotSize * swapchainImageIndex;
+		memcpy(slot + viewProjectionOffset, viewProjection, sizeof(viewProjection));
+		modelMatrices.Upload(swapchainImageIndex, modelMatricesRing.memory.mapped + modelMatricesSlotSize * swapchainImageIndex);
+		pointLights.Upload(swapchainImageIndex, slot + pointLightsOffset);
 	}
 
 	// Handle Window
 	{
+		PROFILE_ZONE("Handle Window");
 		//gRenderer = this;
-		++frameCount;
-		sumFPS += (int)(1 / (Engine::timer.GetTime() - lastTime));
+		double time = Engine::timer.GetTime();
+		frameStatistics.Add(time - lastTime);
+		lastTime = time;
+
+		// SetWindowText waits on the window thread, so only a few times per second
+		if (time - lastTitleTime >= FRAME_STATISTICS_TITLE_INTERVAL)
+		{
+			lastTitleTime = time;
 
-		SetWindowText(window.hWnd, (std::to_string((int)(1 / (Engine::timer.GetTime() - lastTime))) + std::string(" - FPS    ") + std::to_string(sumFPS / frameCount) + std::string(" - AVG")).c_str());
+			FrameStatistics::Summary summary = frameStatistics.GetSummary();
+			char title[160];
+			snprintf(title, sizeof(title), "%.0f FPS    p50 %.2f ms    p95 %.2f ms    p99 %.2f ms    max %.2f ms    GPU %.2f ms", 1.0 / summary.average, summary.p50 * 1000.0, summary.p95 * 1000.0, summary.p99 * 1000.0, summary.max * 1000.0, gpuStatistics.renderPassTime * 1000.0);
+			SetWindowText(window.hWnd, title);
+		}
 
-		lastTime = Engine::timer.GetTime();
 		MSG msg;
 		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
 		{
@@ -1605,6 +1840,7 @@ void Renderer::Render()
 
 	// Render
 	{
+		PROFILE_ZONE("Submit & Present");
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
 		VkSubmitInfo submitInfo;
@@ -1620,6 +1856,9 @@ void Renderer::Render()
 
 		VK_CHECK_RESULT(vkQueueSubmit(device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0], 1, &submitInfo, renderFences[swapchainImageIndex]), "????????????????", "vkQueueSubmit");
 
+		frameQueries[swapchainImageIndex].pending = timestampsSupported || pipelineStatisticsSupported;
+		frameQueries[swapchainImageIndex].submitTime = Profiler::Get().Now();
+
 		VkPresentInfoKHR presentInfoKHR;
 		presentInfoKHR.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		presentInfoKHR.pNext = nullptr;
@@ -1632,108 +1871,138 @@ void Renderer::Render()
 
 		VK_CHECK_RESULT(vkQueuePresentKHR(device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0], &presentInfoKHR), "????????????????", "vkQueuePresentKHR");
 	}
+
+#if _DEBUG
+	debugReportSink.EndFrame();
+#endif
 }
 void Renderer::ShutDown()
 {
 	vkDeviceWaitIdle(device.handle);
 
-	// vertexBuffers / indexBuffers
-	VkU::DestroyBuffer(device.handle, indexBuffer);
-	VkU::DestroyBuffer(device.handle, vertexBuffer);
+	// frame statistics
+	frameStatistics.Save("_FrameStatistics.csv", "_FrameStatistics.json");
+
+	// geometryBuffer
+	VkU::DestroyGeometryBuffer(device.handle, geometryBuffer);
+
+	// worker pool
+	workerPool.ShutDown();
 
 	// textures
 	for (size_t i = 0; i != imageBuffers.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, imageBuffers[i].view, nullptr), imageBuffers[i].view, "vkDestroyImageView");
-		VK_CHECK_CLEANUP(vkDestroyImage(device.handle, imageBuffers[i].handle, nullptr), imageBuffers[i].handle, "vkDestroyBuffer");
-		VK_CHECK_CLEANUP(vkFreeMemory(device.handle, imageBuffers[i].memory, nullptr), imageBuffers[i].memory, "vkFreeMemory");
+		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, imageBuffers[i].view, memoryTracker.Callbacks(MemoryTracker::CATEGORY_TEXTURES)), imageBuffers[i].view, "vkDestroyImageView");
+		VK_CHECK_CLEANUP(vkDestroyImage(device.handle, imageBuffers[i].handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_TEXTURES)), imageBuffers[i].handle, "vkDestroyBuffer");
+		VK_CHECK_CLEANUP(memoryPool.Free(imageBuffers[i].memory), imageBuffers[i].memory.handle, "MemoryPool::Free");
 	}
 	imageBuffers.clear();
 
 	// shader modules
 	for (size_t i = 0; i != shaderModules.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyShaderModule(device.handle, shaderModules[i].handle, nullptr), shaderModules[i].handle, "vkDestroyShaderModule");
+		VK_CHECK_CLEANUP(vkDestroyShaderModule(device.handle, shaderModules[i].handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), shaderModules[i].handle, "vkDestroyShaderModule");
 	}
 	shaderModules.clear();
 
-	// pointLights
-	VkU::DestroyBuffer(device.handle, pointLightsBuffer);
-	VkU::DestroyBuffer(device.handle, pointLightsStagingBuffer);
+	// uniform ring
+	VkU::DestroyBuffer(device.handle, uniformRing);
 
-	// model matrices
-	VkU::DestroyBuffer(device.handle, modelMatricesBuffer);
-	VkU::DestroyBuffer(device.handle, modelMatricesStagingBuffer);
-
-	// camera
-	VkU::DestroyBuffer(device.handle, viewProjectionBuffer);
-	VkU::DestroyBuffer(device.handle, viewProjectionStagingBuffer);
+	// model matrices ring, the retired descriptor sets go with the pool
+	VkU::DestroyBuffer(device.handle, modelMatricesRing);
+	for (size_t i = 0; i != retiredBuffers.size(); ++i)
+	{
+		for (size_t j = 0; j != retiredBuffers[i].size(); ++j)
+			VkU::DestroyBuffer(device.handle, retiredBuffers[i][j]);
+	}
+	retiredBuffers.clear();
+	retiredDescriptorSets.clear();
 
 	//pipelines
 	for (size_t i = 0; i != pipelines.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyPipeline(device.handle, pipelines[i], nullptr), pipelines[i], "vkDestroyPipeline");
+		VK_CHECK_CLEANUP(vkDestroyPipeline(device.handle, pipelines[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), pipelines[i], "vkDestroyPipeline");
 	}
 	pipelines.clear();
 
 	// pipeline layout
-	VK_CHECK_CLEANUP(vkDestroyPipelineLayout(device.handle, pipelineLayout, nullptr), pipelineLayout, "vkDestroyPipelineLayout");
+	VK_CHECK_CLEANUP(vkDestroyPipelineLayout(device.handle, pipelineLayout, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), pipelineLayout, "vkDestroyPipelineLayout");
 
 	// descriptorSet Layout
-	VK_CHECK_CLEANUP(vkDestroyDescriptorSetLayout(device.handle, descriptorSetLayout, nullptr), descriptorSetLayout, "vkDestroyDescriptorSetLayout");
+	VK_CHECK_CLEANUP(vkDestroyDescriptorSetLayout(device.handle, descriptorSetLayout, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), descriptorSetLayout, "vkDestroyDescriptorSetLayout");
+
+	// query pools
+	for (size_t i = 0; i != frameQueries.size(); ++i)
+	{
+		if (frameQueries[i].timestamps != VK_NULL_HANDLE)
+			VK_CHECK_CLEANUP(vkDestroyQueryPool(device.handle, frameQueries[i].timestamps, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), frameQueries[i].timestamps, "vkDestroyQueryPool");
+		if (frameQueries[i].pipelineStatistics != VK_NULL_HANDLE)
+			VK_CHECK_CLEANUP(vkDestroyQueryPool(device.handle, frameQueries[i].pipelineStatistics, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), frameQueries[i].pipelineStatistics, "vkDestroyQueryPool");
+	}
+	frameQueries.clear();
 
 	// render fences
 	for (size_t i = 0; i != renderFences.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyFence(device.handle, renderFences[i], nullptr), renderFences[i], "vkDestroyFence");
+		VK_CHECK_CLEANUP(vkDestroyFence(device.handle, renderFences[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), renderFences[i], "vkDestroyFence");
 	}
 	renderFences.clear();
 
 	// semaphores
-	VK_CHECK_CLEANUP(vkDestroySemaphore(device.handle, semaphoreImageAvailable, nullptr), semaphoreImageAvailable, "vkDestroySemaphore");
-	VK_CHECK_CLEANUP(vkDestroySemaphore(device.handle, semaphoreRenderDone, nullptr), semaphoreRenderDone, "vkDestroySemaphore");
+	VK_CHECK_CLEANUP(vkDestroySemaphore(device.handle, semaphoreImageAvailable, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), semaphoreImageAvailable, "vkDestroySemaphore");
+	VK_CHECK_CLEANUP(vkDestroySemaphore(device.handle, semaphoreRenderDone, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), semaphoreRenderDone, "vkDestroySemaphore");
 
 	// swapchain
 	for (size_t i = 0; i != swapchain.framebuffers.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyFramebuffer(device.handle, swapchain.framebuffers[i], nullptr), swapchain.framebuffers[i], "vkDestroyFramebuffer");
+		VK_CHECK_CLEANUP(vkDestroyFramebuffer(device.handle, swapchain.framebuffers[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN)), swapchain.framebuffers[i], "vkDestroyFramebuffer");
 	}
 	swapchain.framebuffers.clear();
 	for (size_t i = 0; i != swapchain.views.size(); ++i)
 	{
-		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, swapchain.views[i], nullptr), swapchain.views[i], "vkDestroyImageView");
+		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, swapchain.views[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN)), swapchain.views[i], "vkDestroyImageView");
 	}
-	VK_CHECK_CLEANUP(vkDestroySwapchainKHR(device.handle, swapchain.handle, nullptr), swapchain.handle, "vkDestroySwapchainKHR");
+	VK_CHECK_CLEANUP(vkDestroySwapchainKHR(device.handle, swapchain.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_SWAPCHAIN)), swapchain.handle, "vkDestroySwapchainKHR");
 	swapchain.views.clear();
 
 	// depth Image
 	if (depthImage.view != nullptr)
-		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, depthImage.view, nullptr), depthImage.view, "vkDestroyImageView");
+		VK_CHECK_CLEANUP(vkDestroyImageView(device.handle, depthImage.view, memoryTracker.Callbacks(MemoryTracker::CATEGORY_DEPTH)), depthImage.view, "vkDestroyImageView");
 	if (depthImage.handle != nullptr)
-		VK_CHECK_CLEANUP(vkDestroyImage(device.handle, depthImage.handle, nullptr), depthImage.handle, "vkDestroyBuffer");
-	if (depthImage.memory != nullptr)
-		VK_CHECK_CLEANUP(vkFreeMemory(device.handle, depthImage.memory, nullptr), depthImage.memory, "vkFreeMemory");
+		VK_CHECK_CLEANUP(vkDestroyImage(device.handle, depthImage.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_DEPTH)), depthImage.handle, "vkDestroyBuffer");
+	if (depthImage.memory.handle != nullptr)
+		VK_CHECK_CLEANUP(memoryPool.Free(depthImage.memory), depthImage.memory.handle, "MemoryPool::Free");
 
 	// sampler
-	VK_CHECK_CLEANUP(vkDestroySampler(device.handle, sampler, nullptr), sampler, "vkDestroySampler");
+	VK_CHECK_CLEANUP(vkDestroySampler(device.handle, sampler, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), sampler, "vkDestroySampler");
 
 	// descriptorPool
-	VK_CHECK_CLEANUP(vkDestroyDescriptorPool(device.handle, descriptorPool, nullptr), descriptorPool, "vkDestroyDescriptorSetLayout");
+	VK_CHECK_CLEANUP(vkDestroyDescriptorPool(device.handle, descriptorPool, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), descriptorPool, "vkDestroyDescriptorSetLayout");
 
 	// setup fence
-	VK_CHECK_CLEANUP(vkDestroyFence(device.handle, setupFence, nullptr), setupFence, "vkDestroyFence");
+	VK_CHECK_CLEANUP(vkDestroyFence(device.handle, setupFence, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), setupFence, "vkDestroyFence");
+
+	// transfer batch
+	VkU::DestroyTransferBatch(device.handle, transferBatch);
 
 	// renderPass
-	VK_CHECK_CLEANUP(vkDestroyRenderPass(device.handle, renderPass, nullptr), renderPass, "vkDestroyRenderPass");
+	VK_CHECK_CLEANUP(vkDestroyRenderPass(device.handle, renderPass, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), renderPass, "vkDestroyRenderPass");
 
 	// commandPool
-	VK_CHECK_CLEANUP(vkDestroyCommandPool(device.handle, commandPool, nullptr), commandPool, "vkDestroyCommandPool");
+	VK_CHECK_CLEANUP(vkDestroyCommandPool(device.handle, commandPool, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), commandPool, "vkDestroyCommandPool");
+
+	// memory pool
+	uint64_t leakedAllocations = memoryPool.Destroy();
+#if _DEBUG
+	if (leakedAllocations != 0)
+		logger << "WARNING: " << leakedAllocations << " memory pool allocations still alive at ShutDown.\n";
+#endif
 
 	// device
-	VK_CHECK_CLEANUP(vkDestroyDevice(device.handle, nullptr), device.handle, "vkDestroyDevice");
+	VK_CHECK_CLEANUP(vkDestroyDevice(device.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), device.handle, "vkDestroyDevice");
 
 	// suface
-	VK_CHECK_CLEANUP(vkDestroySurfaceKHR(instance, surface.handle, nullptr), surface.handle, "vkDestroySurfaceKHR");
+	VK_CHECK_CLEANUP(vkDestroySurfaceKHR(instance, surface.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), surface.handle, "vkDestroySurfaceKHR");
 
 	// window
 	DestroyWindow(window.hWnd);
@@ -1743,53 +2012,494 @@ void Renderer::ShutDown()
 	if (debugReportCallback != VK_NULL_HANDLE)
 	{
 		PFN_vkDestroyDebugReportCallbackEXT FP_vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
-		VK_CHECK_CLEANUP(FP_vkDestroyDebugReportCallbackEXT(instance, debugReportCallback, nullptr), debugReportCallback, "FP_vkDestroyDebugReportCallbackEXT");
+		VK_CHECK_CLEANUP(FP_vkDestroyDebugReportCallbackEXT(instance, debugReportCallback, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), debugReportCallback, "FP_vkDestroyDebugReportCallbackEXT");
 	}
+#if _DEBUG
+	debugReportSink.Flush();
+#endif
 
 	// instance
-	VK_CHECK_CLEANUP(vkDestroyInstance(instance, nullptr), instance, "vkDestroyInstance");
-}
-
-
-
+	VK_CHECK_CLEANUP(vkDestroyInstance(instance, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), instance, "vkDestroyInstance");
 
+	// memory
+	memoryTracker.Report("_MemoryReport.txt");
+#if _DEBUG
+	if (memoryTracker.GetHostTotal().allocations != 0 || memoryTracker.GetDeviceTotal().allocations != 0)
+		logger << "WARNING: " << memoryTracker.GetHostTotal().allocations << " host and " << memoryTracker.GetDeviceTotal().allocations << " device allocations still alive after ShutDown, see _MemoryReport.txt.\n";
+#endif
 
-VkFormat VkU::GetDepthFormat(VkPhysicalDevice _physicalDevices, std::vector<VkFormat>* _preferedDepthFormat)
+	// call trace
+#if _DEBUG || defined(VK_CALL_TRACE)
+	callTrace.Save("_RendererCallTrace.bin");
+#endif
+}
+DebugReportSink* Renderer::GetDebugReportSink()
 {
-	if (_preferedDepthFormat != nullptr)
+#if _DEBUG
+	return &debugReportSink;
+#else
+	return nullptr;
+#endif
+}
+void Renderer::DecodeImages(WorkerPool& _workerPool, const std::vector<const char*>& _imageNames, std::vector<VkU::ImageData>& _images)
+{
+	_images.resize(_imageNames.size());
+	for (size_t i = 0; i != _imageNames.size(); ++i)
 	{
-		for (uint32_t j = 0; j != _preferedDepthFormat->size(); ++j)
+		const char* imageName = _imageNames[i];
+		VkU::ImageData* decodedImage = &_images[i];
+		decodedImage->data = nullptr;
+		_workerPool.Submit([imageName, decodedImage]()
 		{
-			VkFormatProperties formatProperties;
-			vkGetPhysicalDeviceFormatProperties(_physicalDevices, (*_preferedDepthFormat)[j], &formatProperties);
-
-			if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) == VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
-			{
-				return (*_preferedDepthFormat)[j];
-			}
-		}
+			PROFILE_ZONE("decode image");
+			VkU::LoadImageTGA(imageName, decodedImage->width, decodedImage->height, decodedImage->channelCount, decodedImage->bytesPerChannel, decodedImage->data);
+			decodedImage->mipLevelCount = 1;
+#ifdef TEXTURE_MIPMAPS
+			VkU::GenerateMipChain(*decodedImage);
+#endif
+		});
 	}
-	else
+}
+void Renderer::ImportModels(WorkerPool& _workerPool, const std::vector<const char*>& _modelNames, std::vector<VkU::Meshes>& _meshes, bool _meshCache)
+{
+	_meshes.resize(_modelNames.size());
+	for (size_t i = 0; i != _modelNames.size(); ++i)
 	{
-		for (uint32_t j = 0; j != sizeof(preferedAllDepthFormats) / sizeof(VkFormat); ++j)
+		const char* modelName = _modelNames[i];
+		VkU::Meshes* importedMeshes = &_meshes[i];
+		_workerPool.Submit([modelName, importedMeshes, _meshCache]()
 		{
-			VkFormatProperties formatProperties;
-			vkGetPhysicalDeviceFormatProperties(_physicalDevices, preferedAllDepthFormats[j], &formatProperties);
+			PROFILE_ZONE("import model");
+			aiPostProcessSteps postProcessSteps = (aiPostProcessSteps)(aiProcess_GenNormals | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
+			if (_meshCache)
+				VkU::LoadModel(modelName, *importedMeshes, postProcessSteps);
+			else
+				VkU::ImportModel(modelName, *importedMeshes, postProcessSteps);
+		});
+	}
+}
+double Renderer::MeasureModelImport(const std::vector<const char*>& _modelNames, uint32_t _threadCount, bool _meshCache)
+{
+	WorkerPool measuredWorkerPool;
+	measuredWorkerPool.Init(_threadCount);
 
-			if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) == VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
-			{
-				return preferedAllDepthFormats[j];
-			}
-		}
+	std::vector<VkU::Meshes> rmeshes;
+	long long start = Timer::GetTimestamp();
+	ImportModels(measuredWorkerPool, _modelNames, rmeshes, _meshCache);
+	measuredWorkerPool.Wait();
+	double seconds = (Timer::GetTimestamp() - start) * 0.000000001;
+
+	measuredWorkerPool.ShutDown();
+	for (size_t i = 0; i != rmeshes.size(); ++i)
+	{
+		delete[] rmeshes[i].indexData;
+		delete[] rmeshes[i].vertexData;
 	}
 
-	return VK_FORMAT_UNDEFINED;
+	return seconds;
 }
-
-VkU::Window VkU::GetWindow(uint32_t _width, uint32_t _height, const char * _title, const char * _name, WNDPROC _wndProc)
+double Renderer::MeasureImageDecode(const char* _filename, uint32_t _runCount, uint64_t& _decodedSize)
 {
-	Window window;
-	window.hInstance = GetModuleHandle(NULL);
+	double best = 0.0;
+	VkU::ImageData image = {};
+	for (uint32_t r = 0; r != _runCount; ++r)
+	{
+		long long start = Timer::GetTimestamp();
+		VkU::LoadImageTGA(_filename, image.width, image.height, image.channelCount, image.bytesPerChannel, image.data);
+		double seconds = (Timer::GetTimestamp() - start) * 0.000000001;
+		if (r == 0 || seconds < best)
+			best = seconds;
+	}
+
+	_decodedSize = (uint64_t)image.width * image.height * image.channelCount * image.bytesPerChannel;
+	delete[] image.data;
+
+	return best;
+}
+uint32_t Renderer::AddModel(glm::mat4 _modelMatrix, uint32_t _mesh)
+{
+	// the GPU side follows in the next Render
+	if (modelCount == modelMatrices.Size())
+	{
+		modelMatrices.Resize(modelMatrices.Size() * 2, (uint32_t)renderFences.size());
+		modelMeshes.resize(modelMatrices.Size(), 0);
+	}
+
+	modelMatrices.Modify(modelCount) = _modelMatrix;
+	modelMeshes[modelCount] = _mesh;
+	return modelCount++;
+}
+void Renderer::CreateModelMatricesRing()
+{
+	VkDeviceSize alignment = physicalDevices[device.physicalDeviceIndex].properties.limits.minStorageBufferOffsetAlignment;
+	modelMatricesSlotSize = (sizeof(glm::mat4) * maxGpuModelMatrixCount + alignment - 1) & ~(alignment - 1);
+
+	modelMatricesRing = VkU::CreateHostStorageBuffer(device.handle, physicalDevices[device.physicalDeviceIndex], modelMatricesSlotSize * renderFences.size(), hostWriteMemoryPropertyFlags);
+}
+void Renderer::GrowModelMatrices()
+{
+	PROFILE_ZONE("Grow model matrices");
+
+	VkDescriptorSet oldDescriptorSet = descriptorSet;
+	VkDescriptorSet newDescriptorSet;
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.pNext = nullptr;
+	descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = 1;
+	descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device.handle, &descriptorSetAllocateInfo, &newDescriptorSet), newDescriptorSet, "vkAllocateDescriptorSets");
+
+	// keep the current storage and drop the models that do not fit, Upload would overrun the ring otherwise
+	if (vkResult != VK_SUCCESS)
+	{
+#if _DEBUG
+		logger << "ERROR: vkAllocateDescriptorSets failed while growing the model matrices to " << modelMatrices.Size() << ", models past " << maxGpuModelMatrixCount << " are dropped.\n";
+#endif
+		modelMatrices.Resize(maxGpuModelMatrixCount, (uint32_t)renderFences.size());
+		modelMeshes.resize(maxGpuModelMatrixCount, 0);
+		if (modelCount > maxGpuModelMatrixCount)
+			modelCount = maxGpuModelMatrixCount;
+		return;
+	}
+
+	retiredBuffers[swapchainImageIndex].push_back(modelMatricesRing);
+	retiredDescriptorSets[swapchainImageIndex].push_back(oldDescriptorSet);
+	descriptorSet = newDescriptorSet;
+
+	// resized to the new capacity and dirty in every slot
+	maxGpuModelMatrixCount = (uint32_t)modelMatrices.Size();
+	CreateModelMatricesRing();
+
+	// everything but the model matrices is copied from the old set
+	uint32_t copiedBindings[] = { VIEW_PROJECTION_UNIFORM_BINDING, POINT_LIGHT_UNIFORM_BINDING, TEXTURE_UNIFORM_BINDING };
+	VkCopyDescriptorSet copyDescriptorSets[sizeof(copiedBindings) / sizeof(uint32_t)];
+	for (size_t i = 0; i != sizeof(copiedBindings) / sizeof(uint32_t); ++i)
+	{
+		copyDescriptorSets[i].sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+		copyDescriptorSets[i].pNext = nullptr;
+		copyDescriptorSets[i].srcSet = oldDescriptorSet;
+		copyDescriptorSets[i].srcBinding = copiedBindings[i];
+		copyDescriptorSets[i].srcArrayElement = 0;
+		copyDescriptorSets[i].dstSet = descriptorSet;
+		copyDescriptorSets[i].dstBinding = copiedBindings[i];
+		copyDescriptorSets[i].dstArrayElement = 0;
+		copyDescriptorSets[i].descriptorCount = 1;
+	}
+
+	VkDescriptorBufferInfo modelMatricesDescriptorBufferInfo;
+	modelMatricesDescriptorBufferInfo.buffer = modelMatricesRing.handle;
+	modelMatricesDescriptorBufferInfo.offset = 0;
+	modelMatricesDescriptorBufferInfo.range = sizeof(glm::mat4) * maxGpuModelMatrixCount;
+
+	VkWriteDescriptorSet modelMatricesWriteDescriptorSet;
+	modelMatricesWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	modelMatricesWriteDescriptorSet.pNext = nullptr;
+	modelMatricesWriteDescriptorSet.dstSet = descriptorSet;
+	modelMatricesWriteDescriptorSet.dstBinding = MODEL_MATRICES_UNIFORM_BINDING;
+	modelMatricesWriteDescriptorSet.dstArrayElement = 0;
+	modelMatricesWriteDescriptorSet.descriptorCount = 1;
+	modelMatricesWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	modelMatricesWriteDescriptorSet.pImageInfo = nullptr;
+	modelMatricesWriteDescriptorSet.pBufferInfo = &modelMatricesDescriptorBufferInfo;
+	modelMatricesWriteDescriptorSet.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(device.handle, 1, &modelMatricesWriteDescriptorSet, sizeof(copyDescriptorSets) / sizeof(VkCopyDescriptorSet), copyDescriptorSets);
+}
+bool Renderer::TestMemoryPool(uint32_t _resourceCount, MemoryPool::Statistics& _peak)
+{
+	PROFILE_ZONE("Renderer::TestMemoryPool");
+
+	VkU::PhysicalDevice& physicalDevice = physicalDevices[device.physicalDeviceIndex];
+	MemoryPool::Statistics start = memoryPool.GetStatistics();
+	_peak = start;
+
+	std::mt19937 random(1);
+	std::vector<VkU::Buffer> buffers;
+	std::vector<VkU::Image> images;
+	bool valid = true;
+
+	for (uint32_t round = 0; round != 4 && valid; ++round)
+	{
+		// create, mostly small resources with a few larger than half a block
+		for (uint32_t i = 0; i != _resourceCount && valid; ++i)
+		{
+			VkDeviceSize size = random() % 256 == 0 ? (MEMORY_POOL_BLOCK_SIZE / 2) + 1 + random() % (8 << 20) : 1 + random() % (256 << 10);
+			switch (random() % 5)
+			{
+			case 0:
+				buffers.push_back(VkU::CreateUniformBuffer(device.handle, physicalDevice, size));
+				break;
+			case 1:
+				buffers.push_back(VkU::CreateVertexBuffer(device.handle, physicalDevice, size));
+				break;
+			case 2:
+				buffers.push_back(VkU::CreateIndexBuffer(device.handle, physicalDevice, size));
+				break;
+			case 3:
+				buffers.push_back(VkU::CreateStagingBuffer(device.handle, physicalDevice, size));
+				break;
+			case 4:
+			{
+				VkU::Image image = {};
+				VkU::CreateSampledImage(device.handle, physicalDevice, image, VK_FORMAT_B8G8R8A8_UNORM, { 1 + random() % 512, 1 + random() % 512, 1 });
+				images.push_back(image);
+				break;
+			}
+			}
+			valid = vkResult == VK_SUCCESS;
+		}
+
+		MemoryPool::Statistics statistics = memoryPool.GetStatistics();
+		if (statistics.blockCount > _peak.blockCount)
+			_peak = statistics;
+		valid = valid && memoryPool.Validate() && statistics.blockCount <= memoryPool.GetMaxMemoryAllocationCount();
+
+		// no two live resources may share bytes
+		std::vector<MemoryPool::Allocation> allocations;
+		for (size_t i = 0; i != buffers.size(); ++i)
+			allocations.push_back(buffers[i].memory);
+		for (size_t i = 0; i != images.size(); ++i)
+			allocations.push_back(images[i].memory);
+		std::sort(allocations.begin(), allocations.end(), [](const MemoryPool::Allocation& _a, const MemoryPool::Allocation& _b) { return _a.handle != _b.handle ? _a.handle < _b.handle : _a.offset < _b.offset; });
+		for (size_t i = 1; i < allocations.size(); ++i)
+		{
+			if (allocations[i].handle == allocations[i - 1].handle && allocations[i - 1].offset + allocations[i - 1].size > allocations[i].offset)
+				valid = false;
+		}
+
+		// destroy two thirds in random order, the rest stays to fragment the next round
+		std::shuffle(buffers.begin(), buffers.end(), random);
+		std::shuffle(images.begin(), images.end(), random);
+		while (buffers.size() > _resourceCount / 3 * 4 / 5)
+		{
+			VkU::DestroyBuffer(device.handle, buffers.back());
+			buffers.pop_back();
+		}
+		while (images.size() > _resourceCount / 3 / 5)
+		{
+			VkU::DestroyImage(device.handle, images.back());
+			images.pop_back();
+		}
+		valid = valid && memoryPool.Validate();
+	}
+
+	for (size_t i = 0; i != buffers.size(); ++i)
+		VkU::DestroyBuffer(device.handle, buffers[i]);
+	for (size_t i = 0; i != images.size(); ++i)
+		VkU::DestroyImage(device.handle, images[i]);
+
+	MemoryPool::Statistics end = memoryPool.GetStatistics();
+	return valid && memoryPool.Validate() && end.allocationCount == start.allocationCount;
+}
+bool Renderer::TestMipmaps()
+{
+	PROFILE_ZONE("Renderer::TestMipmaps");
+
+	VkU::PhysicalDevice& physicalDevice = physicalDevices[device.physicalDeviceIndex];
+	std::mt19937 random(1);
+	bool valid = true;
+
+	// odd and one texel wide sizes, so levels round down and average texels with themselves,
+	// 4 channels take the SSE2 filter and 3 channels the scalar one
+	struct MipmapCase
+	{
+		uint32_t width;
+		uint32_t height;
+		uint8_t channelCount;
+	};
+	const MipmapCase cases[] = { { 37, 20, 4 }, { 64, 64, 4 }, { 1, 9, 4 }, { 203, 5, 4 }, { 37, 20, 3 }, { 1, 9, 3 }, { 203, 5, 3 }, { 13, 1, 3 } };
+	for (uint32_t e = 0; e != sizeof(cases) / sizeof(MipmapCase) && valid; ++e)
+	{
+		uint32_t width = cases[e].width;
+		uint32_t height = cases[e].height;
+		uint8_t texelSize = cases[e].channelCount;
+		VkFormat format = texelSize == 3 ? VK_FORMAT_B8G8R8_UNORM : VK_FORMAT_B8G8R8A8_UNORM;
+
+		VkU::ImageData image = { width, height, texelSize, 1, nullptr, 1 };
+		image.data = new uint8_t[width * height * texelSize];
+		for (uint32_t i = 0; i != width * height * texelSize; ++i)
+			((uint8_t*)image.data)[i] = (uint8_t)random();
+		VkU::GenerateMipChain(image);
+		const uint8_t* chain = (const uint8_t*)image.data;
+		VkDeviceSize chainSize = VkU::GetMipLevelOffset(width, height, texelSize, image.mipLevelCount);
+
+		// every level against a scalar box filter of the level above
+		for (uint32_t level = 1; level != image.mipLevelCount; ++level)
+		{
+			VkExtent2D source = VkU::GetMipLevelExtent(width, height, level - 1);
+			VkExtent2D destination = VkU::GetMipLevelExtent(width, height, level);
+			const uint8_t* sourceTexels = chain + VkU::GetMipLevelOffset(width, height, texelSize, level - 1);
+			const uint8_t* destinationTexels = chain + VkU::GetMipLevelOffset(width, height, texelSize, level);
+
+			for (uint32_t y = 0; y != destination.height; ++y)
+			{
+				for (uint32_t x = 0; x != destination.width; ++x)
+				{
+					uint32_t x0 = 2 * x, x1 = source.width > 1 ? 2 * x + 1 : 2 * x;
+					uint32_t y0 = 2 * y, y1 = source.height > 1 ? 2 * y + 1 : 2 * y;
+					for (uint32_t c = 0; c != texelSize; ++c)
+					{
+						uint32_t sum = sourceTexels[(y0 * source.width + x0) * texelSize + c] + sourceTexels[(y0 * source.width + x1) * texelSize + c] + sourceTexels[(y1 * source.width + x0) * texelSize + c] + sourceTexels[(y1 * source.width + x1) * texelSize + c];
+						if (destinationTexels[(y * destination.width + x) * texelSize + c] != (sum + 2) / 4)
+							valid = false;
+					}
+				}
+			}
+		}
+
+		// 24 bit formats are optional, the chain is still checked on the CPU above
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice.handle, format, &formatProperties);
+		if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0)
+		{
+#if _DEBUG
+			logger << "WARNING: Format " << format << " can not be sampled, the readback of the " << width << "x" << height << " mip chain is skipped.\n";
+#endif
+			delete[] chain;
+			continue;
+		}
+
+		// upload the way Load does
+		VkU::Image gpuImage = {};
+		VkU::CreateSampledImage(device.handle, physicalDevice, gpuImage, format, { width, height, 1 }, image.mipLevelCount);
+
+		VkU::StagingRegion stagingRegion = VkU::AllocateTransferStaging(device.handle, physicalDevice, transferBatch, chainSize, texelSize * 4);
+		memcpy(stagingRegion.data, chain, chainSize);
+		VkU::ImageCopy imageCopy = { stagingRegion.buffer, stagingRegion.offset, gpuImage, { width, height, 1 }, texelSize, image.mipLevelCount };
+		VkU::EnqueueBufferToImageCopies(device.handle, transferBatch, 1, &imageCopy);
+		VkU::WaitTransferTicket(device.handle, transferBatch, VkU::FlushTransferBatch(transferBatch));
+
+		// read every level back into the same layout
+		VkU::Buffer readback = VkU::CreateStagingBuffer(device.handle, physicalDevice, chainSize);
+		{
+			VkCommandBufferBeginInfo commandBufferBeginInfo;
+			commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			commandBufferBeginInfo.pNext = nullptr;
+			commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			commandBufferBeginInfo.pInheritanceInfo = nullptr;
+			VkU::WaitResetFence(device.handle, 1, &setupFence, VK_TRUE, -1);
+			VK_CHECK_RESULT(vkBeginCommandBuffer(setupCommandBuffer, &commandBufferBeginInfo), "????????????????", "vkBeginCommandBuffer");
+
+			VkImageMemoryBarrier imageMemoryBarrier;
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.pNext = nullptr;
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.image = gpuImage.handle;
+			imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier.subresourceRange.levelCount = image.mipLevelCount;
+			imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(setupCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+			std::vector<VkBufferImageCopy> bufferImageCopies(image.mipLevelCount);
+			for (uint32_t level = 0; level != image.mipLevelCount; ++level)
+			{
+				VkExtent2D extent = VkU::GetMipLevelExtent(width, height, level);
+				bufferImageCopies[level].bufferOffset = VkU::GetMipLevelOffset(width, height, texelSize, level);
+				bufferImageCopies[level].bufferRowLength = 0;
+				bufferImageCopies[level].bufferImageHeight = 0;
+				bufferImageCopies[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				bufferImageCopies[level].imageSubresource.mipLevel = level;
+				bufferImageCopies[level].imageSubresource.baseArrayLayer = 0;
+				bufferImageCopies[level].imageSubresource.layerCount = 1;
+				bufferImageCopies[level].imageOffset = { 0, 0, 0 };
+				bufferImageCopies[level].imageExtent = { extent.width, extent.height, 1 };
+			}
+			vkCmdCopyImageToBuffer(setupCommandBuffer, gpuImage.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.handle, image.mipLevelCount, bufferImageCopies.data());
+
+			VkBufferMemoryBarrier bufferMemoryBarrier;
+			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferMemoryBarrier.pNext = nullptr;
+			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier.buffer = readback.handle;
+			bufferMemoryBarrier.offset = 0;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(setupCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(setupCommandBuffer), "????????????????", "vkEndCommandBuffer");
+
+			VkSubmitInfo submitInfo;
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.pNext = nullptr;
+			submitInfo.waitSemaphoreCount = 0;
+			submitInfo.pWaitSemaphores = nullptr;
+			submitInfo.pWaitDstStageMask = nullptr;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &setupCommandBuffer;
+			submitInfo.signalSemaphoreCount = 0;
+			submitInfo.pSignalSemaphores = nullptr;
+			VK_CHECK_RESULT(vkQueueSubmit(device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0], 1, &submitInfo, setupFence), "????????????????", "vkQueueSubmit");
+			VK_CHECK_RESULT(vkWaitForFences(device.handle, 1, &setupFence, VK_TRUE, -1), "????????????????", "vkWaitForFences");
+		}
+
+		// the padding between levels is not written by either side
+		for (uint32_t level = 0; level != image.mipLevelCount && valid; ++level)
+		{
+			VkExtent2D extent = VkU::GetMipLevelExtent(width, height, level);
+			VkDeviceSize offset = VkU::GetMipLevelOffset(width, height, texelSize, level);
+			valid = memcmp(readback.memory.mapped + offset, chain + offset, (size_t)extent.width * extent.height * texelSize) == 0;
+		}
+		valid = valid && vkResult == VK_SUCCESS;
+
+		VkU::DestroyBuffer(device.handle, readback);
+		VkU::DestroyImage(device.handle, gpuImage);
+		delete[] chain;
+	}
+
+	return valid;
+}
+
+
+
+
+
+VkFormat VkU::GetDepthFormat(VkPhysicalDevice _physicalDevices, std::vector<VkFormat>* _preferedDepthFormat)
+{
+	if (_preferedDepthFormat != nullptr)
+	{
+		for (uint32_t j = 0; j != _preferedDepthFormat->size(); ++j)
+		{
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(_physicalDevices, (*_preferedDepthFormat)[j], &formatProperties);
+
+			if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) == VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			{
+				return (*_preferedDepthFormat)[j];
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t j = 0; j != sizeof(preferedAllDepthFormats) / sizeof(VkFormat); ++j)
+		{
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(_physicalDevices, preferedAllDepthFormats[j], &formatProperties);
+
+			if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) == VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			{
+				return preferedAllDepthFormats[j];
+			}
+		}
+	}
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+VkU::Window VkU::GetWindow(uint32_t _width, uint32_t _height, const char * _title, const char * _name, WNDPROC _wndProc, bool _visible)
+{
+	Window window;
+	window.hInstance = GetModuleHandle(NULL);
 	window.name = _name;
 	window.hWnd = NULL;
 
@@ -1848,6 +2558,9 @@ VkU::Window VkU::GetWindow(uint32_t _width, uint32_t _height, const char * _titl
 	uint32_t y = (screenHeight - windowRect.bottom) / 2;
 	SetWindowPos(window.hWnd, 0, x, y, 0, 0, SWP_NOZORDER | SWP_NOSIZE);
 
+	if (_visible == false)
+		return window;
+
 	ShowWindow(window.hWnd, SW_SHOW);
 	SetForegroundWindow(window.hWnd);
 	SetFocus(window.hWnd);
@@ -1927,6 +2640,30 @@ bool VkU::PickDeviceQueuesIndicesRecursively(std::vector<uint32_t>& _queueFamily
 
 	return false;
 }
+uint32_t VkU::FindDedicatedQueueFamilyIndex(PhysicalDevice _physicalDevice, VkQueueFlags _flags, VkQueueFlags _excludedFlags)
+{
+	// the family with the fewest other capabilities is the most likely to be a separate engine
+	uint32_t familyIndex = (uint32_t)-1;
+	uint32_t familyFlagCount = 0;
+	for (uint32_t i = 0; i != (uint32_t)_physicalDevice.queueFamilyProperties.size(); ++i)
+	{
+		VkQueueFlags queueFlags = _physicalDevice.queueFamilyProperties[i].queueFlags;
+		if ((queueFlags & _flags) != _flags || (queueFlags & _excludedFlags) != 0 || _physicalDevice.queueFamilyProperties[i].queueCount == 0)
+			continue;
+
+		uint32_t flagCount = 0;
+		for (VkQueueFlags f = queueFlags; f != 0; f &= f - 1)
+			++flagCount;
+
+		if (familyIndex == (uint32_t)-1 || flagCount < familyFlagCount)
+		{
+			familyIndex = i;
+			familyFlagCount = flagCount;
+		}
+	}
+
+	return familyIndex;
+}
 std::vector<VkU::Queue> VkU::PickDeviceQueuesIndices(std::vector<Queue> _queues, PhysicalDevice _physicalDevice, std::vector<Surface> _surfaces, bool * _isCompatible)
 {
 	std::vector<std::vector<uint32_t>> deviceQueuesValidIndices;
@@ -2073,6 +2810,29 @@ static uint32_t VkU::FindMemoryTypeIndex(VkMemoryRequirements _memoryRequirement
 
 	return -1;
 }
+VkU::MEMORY_TOPOLOGY VkU::GetMemoryTopology(PhysicalDevice _physicalDevice)
+{
+	VkMemoryPropertyFlags hostVisibleDeviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VkDeviceSize largestHeapSize = 0;
+	for (uint32_t i = 0; i != _physicalDevice.memoryProperties.memoryTypeCount; ++i)
+	{
+		VkMemoryType memoryType = _physicalDevice.memoryProperties.memoryTypes[i];
+		if ((memoryType.propertyFlags & hostVisibleDeviceLocal) == hostVisibleDeviceLocal && _physicalDevice.memoryProperties.memoryHeaps[memoryType.heapIndex].size > largestHeapSize)
+			largestHeapSize = _physicalDevice.memoryProperties.memoryHeaps[memoryType.heapIndex].size;
+	}
+	if (largestHeapSize == 0)
+		return MEMORY_TOPOLOGY_DISCRETE;
+
+	bool allHeapsDeviceLocal = true;
+	for (uint32_t i = 0; i != _physicalDevice.memoryProperties.memoryHeapCount; ++i)
+		allHeapsDeviceLocal = allHeapsDeviceLocal && (_physicalDevice.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	if (allHeapsDeviceLocal)
+		return MEMORY_TOPOLOGY_UNIFIED;
+
+	// the classic BAR window is too small to hold resources
+	return largestHeapSize > BAR_WINDOW_SIZE ? MEMORY_TOPOLOGY_RESIZABLE_BAR : MEMORY_TOPOLOGY_DISCRETE;
+}
 
 VkU::Buffer VkU::CreateUniformBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size)
 {
@@ -2087,23 +2847,66 @@ VkU::Buffer VkU::CreateUniformBuffer(VkDevice _vkDevice, PhysicalDevice _physica
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCreateInfo.queueFamilyIndexCount = 0;
 	bufferCreateInfo.pQueueFamilyIndices = nullptr;
-	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, nullptr, &buffer.handle), buffer.handle, "vkCreateBuffer");
+	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_UNIFORMS), &buffer.handle), buffer.handle, "vkCreateBuffer");
 
 	VkMemoryRequirements memoryRequirements;
 	vkGetBufferMemoryRequirements(_vkDevice, buffer.handle, &memoryRequirements);
 
-	VkMemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = nullptr;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &memoryAllocateInfo, nullptr, &buffer.memory), buffer.memory, "vkAllocateMemory");
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), MemoryTracker::CATEGORY_UNIFORMS, true, buffer.memory), buffer.memory.handle, "MemoryPool::Allocate");
 
-	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory, 0), "????????????????", "vkBindBufferMemory");
+	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory.handle, buffer.memory.offset), "????????????????", "vkBindBufferMemory");
 
 	return buffer;
 }
-VkU::Buffer VkU::CreateVertexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size)
+VkU::Buffer VkU::CreateHostUniformBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags)
+{
+	VkU::Buffer buffer;
+
+	VkBufferCreateInfo bufferCreateInfo;
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = _size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_UNIFORMS), &buffer.handle), buffer.handle, "vkCreateBuffer");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(_vkDevice, buffer.handle, &memoryRequirements);
+
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, _memoryPropertyFlags), MemoryTracker::CATEGORY_UNIFORMS, true, buffer.memory), buffer.memory.handle, "MemoryPool::Allocate");
+
+	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory.handle, buffer.memory.offset), "????????????????", "vkBindBufferMemory");
+
+	return buffer;
+}
+VkU::Buffer VkU::CreateHostStorageBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags)
+{
+	VkU::Buffer buffer;
+
+	VkBufferCreateInfo bufferCreateInfo;
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = _size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_UNIFORMS), &buffer.handle), buffer.handle, "vkCreateBuffer");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(_vkDevice, buffer.handle, &memoryRequirements);
+
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, _memoryPropertyFlags), MemoryTracker::CATEGORY_UNIFORMS, true, buffer.memory), buffer.memory.handle, "MemoryPool::Allocate");
+
+	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory.handle, buffer.memory.offset), "????????????????", "vkBindBufferMemory");
+
+	return buffer;
+}
+VkU::Buffer VkU::CreateVertexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags)
 {
 	VkU::Buffer buffer;
 
@@ -2116,23 +2919,18 @@ VkU::Buffer VkU::CreateVertexBuffer(VkDevice _vkDevice, PhysicalDevice _physical
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCreateInfo.queueFamilyIndexCount = 0;
 	bufferCreateInfo.pQueueFamilyIndices = nullptr;
-	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, nullptr, &buffer.handle), buffer.handle, "vkCreateBuffer");
+	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_VERTEX_INDEX), &buffer.handle), buffer.handle, "vkCreateBuffer");
 
 	VkMemoryRequirements memoryRequirements;
 	vkGetBufferMemoryRequirements(_vkDevice, buffer.handle, &memoryRequirements);
 
-	VkMemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = nullptr;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &memoryAllocateInfo, nullptr, &buffer.memory), buffer.memory, "vkAllocateMemory");
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, _memoryPropertyFlags), MemoryTracker::CATEGORY_VERTEX_INDEX, true, buffer.memory), buffer.memory.handle, "MemoryPool::Allocate");
 
-	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory, 0), "????????????????", "vkBindBufferMemory");
+	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory.handle, buffer.memory.offset), "????????????????", "vkBindBufferMemory");
 
 	return buffer;
 }
-VkU::Buffer VkU::CreateIndexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size)
+VkU::Buffer VkU::CreateIndexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags)
 {
 	VkU::Buffer buffer;
 
@@ -2145,19 +2943,14 @@ VkU::Buffer VkU::CreateIndexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalD
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCreateInfo.queueFamilyIndexCount = 0;
 	bufferCreateInfo.pQueueFamilyIndices = nullptr;
-	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, nullptr, &buffer.handle), buffer.handle, "vkCreateBuffer");
+	VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &bufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_VERTEX_INDEX), &buffer.handle), buffer.handle, "vkCreateBuffer");
 
 	VkMemoryRequirements memoryRequirements;
 	vkGetBufferMemoryRequirements(_vkDevice, buffer.handle, &memoryRequirements);
 
-	VkMemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = nullptr;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &memoryAllocateInfo, nullptr, &buffer.memory), buffer.memory, "vkAllocateMemory");
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, _memoryPropertyFlags), MemoryTracker::CATEGORY_VERTEX_INDEX, true, buffer.memory), buffer.memory.handle, "MemoryPool::Allocate");
 
-	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory, 0), "????????????????", "vkBindBufferMemory");
+	VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, buffer.handle, buffer.memory.handle, buffer.memory.offset), "????????????????", "vkBindBufferMemory");
 
 	return buffer;
 }
@@ -2172,56 +2965,322 @@ VkU::Buffer VkU::CreateStagingBuffer(VkDevice _vkDevice, PhysicalDevice _physica
 		stagingBufferCreateInfo.pNext = nullptr;
 		stagingBufferCreateInfo.flags = 0;
 		stagingBufferCreateInfo.size = _size;
-		stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;	// also read back into by TestMipmaps
 		stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		stagingBufferCreateInfo.queueFamilyIndexCount = 0;
 		stagingBufferCreateInfo.pQueueFamilyIndices = nullptr;
-		VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &stagingBufferCreateInfo, nullptr, &stagingBuffer.handle), stagingBuffer.handle, "vkCreateBuffer");
+		VK_CHECK_RESULT(vkCreateBuffer(_vkDevice, &stagingBufferCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_STAGING), &stagingBuffer.handle), stagingBuffer.handle, "vkCreateBuffer");
 
 		VkMemoryRequirements stagingMemoryRequirements;
 		vkGetBufferMemoryRequirements(_vkDevice, stagingBuffer.handle, &stagingMemoryRequirements);
 
-		VkMemoryAllocateInfo stagingMemoryAllocateInfo;
-		stagingMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		stagingMemoryAllocateInfo.pNext = nullptr;
-		stagingMemoryAllocateInfo.allocationSize = stagingMemoryRequirements.size;
-		stagingMemoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(stagingMemoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &stagingMemoryAllocateInfo, nullptr, &stagingBuffer.memory), stagingBuffer.memory, "vkAllocateMemory");
+		VK_CHECK_RESULT(memoryPool.Allocate(stagingMemoryRequirements, VkU::FindMemoryTypeIndex(stagingMemoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT), MemoryTracker::CATEGORY_STAGING, true, stagingBuffer.memory), stagingBuffer.memory.handle, "MemoryPool::Allocate");
 
-		VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, stagingBuffer.handle, stagingBuffer.memory, 0), 0, "vkBindBufferMemory");
+		VK_CHECK_RESULT(vkBindBufferMemory(_vkDevice, stagingBuffer.handle, stagingBuffer.memory.handle, stagingBuffer.memory.offset), 0, "vkBindBufferMemory");
 	}
 
 	return stagingBuffer;
 }
 void VkU::FillStagingBuffer(VkDevice _vkDevice, Buffer _stagingBuffer, VkDeviceSize _size, void* _data)
 {
-	// fill
+	// fill, staging memory stays mapped
 	{
-		void* data;
-		VK_CHECK_RESULT(vkMapMemory(_vkDevice, _stagingBuffer.memory, 0, _size, 0, &data), data, "vkMapMemory");
-		memcpy(data, _data, _size);
-		vkUnmapMemory(_vkDevice, _stagingBuffer.memory);
+		memcpy(_stagingBuffer.memory.mapped, _data, _size);
 	}
 }
-void VkU::TransferStagingBuffer(Device _device, VkCommandBuffer _commandBuffer, VkFence& _fence, Buffer _stagingBuffer, Buffer _dstBuffer, VkDeviceSize _size)
+void VkU::DestroyBuffer(VkDevice _vkDevice, Buffer _buffer)
 {
+	VK_CHECK_CLEANUP(vkDestroyBuffer(_vkDevice, _buffer.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _buffer.handle, "vkDestroyBuffer");
+	VK_CHECK_CLEANUP(memoryPool.Free(_buffer.memory), _buffer.memory.handle, "MemoryPool::Free");
+}
+
+VkU::TransferBatch VkU::CreateTransferBatch(VkDevice _vkDevice, Queue _queue, Queue _acquireQueue, uint32_t _slotCount)
+{
+	VkU::TransferBatch transferBatch;
+
+	transferBatch.queue = _queue.handles[0];
+	transferBatch.queueFamilyIndex = _queue.queueFamilyIndex;
+	transferBatch.acquireQueue = _acquireQueue.handles[0];
+	transferBatch.acquireQueueFamilyIndex = _acquireQueue.queueFamilyIndex;
+	transferBatch.ownershipTransfer = _queue.queueFamilyIndex != _acquireQueue.queueFamilyIndex ? VK_TRUE : VK_FALSE;
+
+	transferBatch.commandBuffers.resize(_slotCount);
+	transferBatch.fences.resize(_slotCount);
+	transferBatch.slotTickets.resize(_slotCount, 0);
+	transferBatch.slotStagingBlocks.resize(_slotCount);
+	transferBatch.stagingBlockCount = 0;
+	transferBatch.slot = 0;
+	transferBatch.recording = VK_FALSE;
+	transferBatch.ticket = 1;
+	transferBatch.copyCount = 0;
+
+	VkCommandPoolCreateInfo commandPoolCreateInfo;
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = transferBatch.queueFamilyIndex;
+	VK_CHECK_RESULT(vkCreateCommandPool(_vkDevice, &commandPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &transferBatch.commandPool), transferBatch.commandPool, "vkCreateCommandPool");
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo;
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = nullptr;
+	commandBufferAllocateInfo.commandPool = transferBatch.commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = _slotCount;
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(_vkDevice, &commandBufferAllocateInfo, transferBatch.commandBuffers.data()), "????????????????", "vkAllocateCommandBuffers");
+
+	// the acquiring half of the ownership transfers runs on the other family, after a semaphore
+	transferBatch.acquireCommandPool = VK_NULL_HANDLE;
+	if (transferBatch.ownershipTransfer == VK_TRUE)
+	{
+		transferBatch.acquireCommandBuffers.resize(_slotCount);
+		transferBatch.semaphores.resize(_slotCount);
+
+		commandPoolCreateInfo.queueFamilyIndex = transferBatch.acquireQueueFamilyIndex;
+		VK_CHECK_RESULT(vkCreateCommandPool(_vkDevice, &commandPoolCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &transferBatch.acquireCommandPool), transferBatch.acquireCommandPool, "vkCreateCommandPool");
+
+		commandBufferAllocateInfo.commandPool = transferBatch.acquireCommandPool;
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(_vkDevice, &commandBufferAllocateInfo, transferBatch.acquireCommandBuffers.data()), "????????????????", "vkAllocateCommandBuffers");
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo;
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreCreateInfo.pNext = nullptr;
+		semaphoreCreateInfo.flags = VK_RESERVED_FOR_FUTURE_USE;
+		for (uint32_t i = 0; i != _slotCount; ++i)
+		{
+			VK_CHECK_RESULT(vkCreateSemaphore(_vkDevice, &semaphoreCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &transferBatch.semaphores[i]), transferBatch.semaphores[i], "vkCreateSemaphore");
+		}
+	}
+
+	VkFenceCreateInfo fenceCreateInfo;
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = nullptr;
+	fenceCreateInfo.flags = 0;
+	for (uint32_t i = 0; i != _slotCount; ++i)
+	{
+		VK_CHECK_RESULT(vkCreateFence(_vkDevice, &fenceCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER), &transferBatch.fences[i]), transferBatch.fences[i], "vkCreateFence");
+	}
+
+	return transferBatch;
+}
+void VkU::ReclaimTransferBatchSlot(VkDevice _vkDevice, TransferBatch& _transferBatch, uint32_t _slot)
+{
+	if (_transferBatch.slotTickets[_slot] == 0)
+		return;
+
+	VkU::WaitResetFence(_vkDevice, 1, &_transferBatch.fences[_slot], VK_TRUE, -1);
+	_transferBatch.slotTickets[_slot] = 0;
+
+	for (size_t i = 0; i != _transferBatch.slotStagingBlocks[_slot].size(); ++i)
+	{
+		_transferBatch.slotStagingBlocks[_slot][i].head = 0;
+		_transferBatch.freeStagingBlocks.push_back(_transferBatch.slotStagingBlocks[_slot][i]);
+	}
+	_transferBatch.slotStagingBlocks[_slot].clear();
+}
+VkCommandBuffer VkU::RecordTransferBatch(VkDevice _vkDevice, TransferBatch& _transferBatch)
+{
+	VkCommandBuffer commandBuffer = _transferBatch.commandBuffers[_transferBatch.slot];
+	if (_transferBatch.recording == VK_TRUE)
+		return commandBuffer;
+
+	ReclaimTransferBatchSlot(_vkDevice, _transferBatch, _transferBatch.slot);
+
 	VkCommandBufferBeginInfo commandBufferBeginInfo;
 	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	commandBufferBeginInfo.pNext = nullptr;
 	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	commandBufferBeginInfo.pInheritanceInfo = nullptr;
-	VK_CHECK_RESULT(vkWaitForFences(_device.handle, 1, &_fence, VK_TRUE, -1), "????????????????", "vkWaitForFences");
-	VK_CHECK_RESULT(vkResetFences(_device.handle, 1, &_fence), "????????????????", "vkResetFences");
-	VK_CHECK_RESULT(vkBeginCommandBuffer(_commandBuffer, &commandBufferBeginInfo), "????????????????", "vkBeginCommandBuffer");
+	VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo), "????????????????", "vkBeginCommandBuffer");
+	if (_transferBatch.ownershipTransfer == VK_TRUE)
+		VK_CHECK_RESULT(vkBeginCommandBuffer(_transferBatch.acquireCommandBuffers[_transferBatch.slot], &commandBufferBeginInfo), "????????????????", "vkBeginCommandBuffer");
+
+	_transferBatch.recording = VK_TRUE;
+	return commandBuffer;
+}
+uint64_t VkU::EnqueueBufferCopy(VkDevice _vkDevice, TransferBatch& _transferBatch, VkBuffer _srcBuffer, VkDeviceSize _srcOffset, Buffer _dstBuffer, VkDeviceSize _dstOffset, VkDeviceSize _size, VkPipelineStageFlags _dstStageMask, VkAccessFlags _dstAccessMask)
+{
+	VkCommandBuffer commandBuffer = RecordTransferBatch(_vkDevice, _transferBatch);
 
 	VkBufferCopy copyRegion;
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
+	copyRegion.srcOffset = _srcOffset;
+	copyRegion.dstOffset = _dstOffset;
 	copyRegion.size = _size;
+	vkCmdCopyBuffer(commandBuffer, _srcBuffer, _dstBuffer.handle, 1, &copyRegion);
+	++_transferBatch.copyCount;
+
+	// make the copy visible to its consumer
+	VkBufferMemoryBarrier bufferMemoryBarrier;
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.pNext = nullptr;
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = _dstAccessMask;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = _dstBuffer.handle;
+	bufferMemoryBarrier.offset = _dstOffset;
+	bufferMemoryBarrier.size = _size;
+	if (_transferBatch.ownershipTransfer == VK_FALSE)
+	{
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, _dstStageMask, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+		return _transferBatch.ticket;
+	}
+
+	// release on the transfer family, the same barrier acquires on the consumer's family
+	bufferMemoryBarrier.srcQueueFamilyIndex = _transferBatch.queueFamilyIndex;
+	bufferMemoryBarrier.dstQueueFamilyIndex = _transferBatch.acquireQueueFamilyIndex;
+	bufferMemoryBarrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+	bufferMemoryBarrier.srcAccessMask = 0;
+	bufferMemoryBarrier.dstAccessMask = _dstAccessMask;
+	vkCmdPipelineBarrier(_transferBatch.acquireCommandBuffers[_transferBatch.slot], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, _dstStageMask, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+	return _transferBatch.ticket;
+}
+uint64_t VkU::EnqueueBufferToImageCopies(VkDevice _vkDevice, TransferBatch& _transferBatch, uint32_t _imageCopyCount, const ImageCopy* _imageCopies)
+{
+	if (_imageCopyCount == 0)
+		return _transferBatch.ticket;
+
+	VkCommandBuffer commandBuffer = RecordTransferBatch(_vkDevice, _transferBatch);
+
+	VkImageSubresourceRange imageSubresourceRange;
+	imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageSubresourceRange.baseMipLevel = 0;
+	imageSubresourceRange.levelCount = 1;
+	imageSubresourceRange.baseArrayLayer = 0;
+	imageSubresourceRange.layerCount = 1;
+
+	// transfer textures to destination
+	std::vector<VkImageMemoryBarrier> imageMemoryBarriers(_imageCopyCount);
+	for (uint32_t i = 0; i != _imageCopyCount; ++i)
+	{
+		imageMemoryBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarriers[i].pNext = nullptr;
+		imageMemoryBarriers[i].srcAccessMask = 0;
+		imageMemoryBarriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarriers[i].oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+		imageMemoryBarriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarriers[i].image = _imageCopies[i].dstImage.handle;
+		imageMemoryBarriers[i].subresourceRange = imageSubresourceRange;
+		imageMemoryBarriers[i].subresourceRange.levelCount = _imageCopies[i].mipLevelCount;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, _imageCopyCount, imageMemoryBarriers.data());
+
+	// copy data, one region per mip level
+	std::vector<VkBufferImageCopy> bufferImageCopies;
+	for (uint32_t i = 0; i != _imageCopyCount; ++i)
+	{
+		const ImageCopy& imageCopy = _imageCopies[i];
+		bufferImageCopies.resize(imageCopy.mipLevelCount);
+		for (uint32_t level = 0; level != imageCopy.mipLevelCount; ++level)
+		{
+			bufferImageCopies[level].bufferOffset = imageCopy.srcOffset + GetMipLevelOffset(imageCopy.extent3D.width, imageCopy.extent3D.height, imageCopy.texelSize, level);
+			bufferImageCopies[level].bufferRowLength = 0;
+			bufferImageCopies[level].bufferImageHeight = 0;
+			bufferImageCopies[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferImageCopies[level].imageSubresource.mipLevel = level;
+			bufferImageCopies[level].imageSubresource.baseArrayLayer = 0;
+			bufferImageCopies[level].imageSubresource.layerCount = 1;
+			bufferImageCopies[level].imageOffset = { 0, 0, 0 };
+			VkExtent2D extent = GetMipLevelExtent(imageCopy.extent3D.width, imageCopy.extent3D.height, level);
+			bufferImageCopies[level].imageExtent = { extent.width, extent.height, 1 };
+		}
+		vkCmdCopyBufferToImage(commandBuffer, imageCopy.srcBuffer, imageCopy.dstImage.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageCopy.mipLevelCount, bufferImageCopies.data());
+		++_transferBatch.copyCount;
+	}
+
+	// transfer textures to shader readable layout
+	for (uint32_t i = 0; i != _imageCopyCount; ++i)
+	{
+		imageMemoryBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageMemoryBarriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	if (_transferBatch.ownershipTransfer == VK_FALSE)
+	{
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, _imageCopyCount, imageMemoryBarriers.data());
+		return _transferBatch.ticket;
+	}
+
+	// the layout transition is part of the release and the acquire, both must describe it identically
+	for (uint32_t i = 0; i != _imageCopyCount; ++i)
+	{
+		imageMemoryBarriers[i].srcQueueFamilyIndex = _transferBatch.queueFamilyIndex;
+		imageMemoryBarriers[i].dstQueueFamilyIndex = _transferBatch.acquireQueueFamilyIndex;
+		imageMemoryBarriers[i].dstAccessMask = 0;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, _imageCopyCount, imageMemoryBarriers.data());
+
+	for (uint32_t i = 0; i != _imageCopyCount; ++i)
+	{
+		imageMemoryBarriers[i].srcAccessMask = 0;
+		imageMemoryBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(_transferBatch.acquireCommandBuffers[_transferBatch.slot], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, _imageCopyCount, imageMemoryBarriers.data());
 
-	vkCmdCopyBuffer(_commandBuffer, _stagingBuffer.handle, _dstBuffer.handle, 1, &copyRegion);
+	return _transferBatch.ticket;
+}
+VkU::StagingRegion VkU::AllocateTransferStaging(VkDevice _vkDevice, PhysicalDevice _physicalDevice, TransferBatch& _transferBatch, VkDeviceSize _size, VkDeviceSize _alignment)
+{
+	// the slot has to be reclaimed before its blocks are handed out again
+	RecordTransferBatch(_vkDevice, _transferBatch);
+	std::vector<StagingBlock>& slotStagingBlocks = _transferBatch.slotStagingBlocks[_transferBatch.slot];
 
-	VK_CHECK_RESULT(vkEndCommandBuffer(_commandBuffer), 0, "vkMapMemory");
+	// the block filled last, then any free block with room, then a new one
+	StagingBlock* stagingBlock = nullptr;
+	VkDeviceSize start = 0;
+	if (slotStagingBlocks.empty() == false)
+	{
+		start = (slotStagingBlocks.back().head + _alignment - 1) / _alignment * _alignment;
+		if (start + _size <= slotStagingBlocks.back().size)
+			stagingBlock = &slotStagingBlocks.back();
+	}
+	if (stagingBlock == nullptr)
+	{
+		size_t i = 0;
+		while (i != _transferBatch.freeStagingBlocks.size() && _transferBatch.freeStagingBlocks[i].size < _size)
+			++i;
+
+		if (i != _transferBatch.freeStagingBlocks.size())
+		{
+			slotStagingBlocks.push_back(_transferBatch.freeStagingBlocks[i]);
+			_transferBatch.freeStagingBlocks.erase(_transferBatch.freeStagingBlocks.begin() + i);
+		}
+		else
+		{
+			StagingBlock newStagingBlock;
+			newStagingBlock.size = _size > TRANSFER_STAGING_BLOCK_SIZE ? _size : TRANSFER_STAGING_BLOCK_SIZE;
+			newStagingBlock.buffer = VkU::CreateStagingBuffer(_vkDevice, _physicalDevice, newStagingBlock.size);
+			newStagingBlock.head = 0;
+			slotStagingBlocks.push_back(newStagingBlock);
+			++_transferBatch.stagingBlockCount;
+		}
+
+		stagingBlock = &slotStagingBlocks.back();
+		start = 0;
+	}
+
+	stagingBlock->head = start + _size;
+
+	VkU::StagingRegion stagingRegion;
+	stagingRegion.buffer = stagingBlock->buffer.handle;
+	stagingRegion.offset = start;
+	stagingRegion.data = stagingBlock->buffer.memory.mapped + start;
+
+	return stagingRegion;
+}
+uint64_t VkU::FlushTransferBatch(TransferBatch& _transferBatch)
+{
+	if (_transferBatch.recording == VK_FALSE)
+		return _transferBatch.ticket - 1;
+
+	VkCommandBuffer commandBuffer = _transferBatch.commandBuffers[_transferBatch.slot];
+	VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "????????????????", "vkEndCommandBuffer");
 
 	VkSubmitInfo submitInfo;
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -2230,51 +3289,130 @@ void VkU::TransferStagingBuffer(Device _device, VkCommandBuffer _commandBuffer,
 	submitInfo.pWaitSemaphores = nullptr;
 	submitInfo.pWaitDstStageMask = nullptr;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &_commandBuffer;
+	submitInfo.pCommandBuffers = &commandBuffer;
 	submitInfo.signalSemaphoreCount = 0;
 	submitInfo.pSignalSemaphores = nullptr;
 
-	VK_CHECK_RESULT(vkQueueSubmit(_device.queues[GRAPHICS_PRESENT_QUEUE_INDEX].handles[0], 1, &submitInfo, _fence), 0, "vkMapMemory");
+	if (_transferBatch.ownershipTransfer == VK_FALSE)
+	{
+		VK_CHECK_RESULT(vkQueueSubmit(_transferBatch.queue, 1, &submitInfo, _transferBatch.fences[_transferBatch.slot]), "????????????????", "vkQueueSubmit");
+	}
+	else
+	{
+		// transfer queue signals, the acquiring queue waits and signals the fence, so the fence covers both
+		VkCommandBuffer acquireCommandBuffer = _transferBatch.acquireCommandBuffers[_transferBatch.slot];
+		VK_CHECK_RESULT(vkEndCommandBuffer(acquireCommandBuffer), "????????????????", "vkEndCommandBuffer");
+
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &_transferBatch.semaphores[_transferBatch.slot];
+		VK_CHECK_RESULT(vkQueueSubmit(_transferBatch.queue, 1, &submitInfo, VK_NULL_HANDLE), "????????????????", "vkQueueSubmit");
+
+		VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo acquireSubmitInfo;
+		acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmitInfo.pNext = nullptr;
+		acquireSubmitInfo.waitSemaphoreCount = 1;
+		acquireSubmitInfo.pWaitSemaphores = &_transferBatch.semaphores[_transferBatch.slot];
+		acquireSubmitInfo.pWaitDstStageMask = &waitDstStageMask;
+		acquireSubmitInfo.commandBufferCount = 1;
+		acquireSubmitInfo.pCommandBuffers = &acquireCommandBuffer;
+		acquireSubmitInfo.signalSemaphoreCount = 0;
+		acquireSubmitInfo.pSignalSemaphores = nullptr;
+		VK_CHECK_RESULT(vkQueueSubmit(_transferBatch.acquireQueue, 1, &acquireSubmitInfo, _transferBatch.fences[_transferBatch.slot]), "????????????????", "vkQueueSubmit");
+	}
+
+	_transferBatch.slotTickets[_transferBatch.slot] = _transferBatch.ticket;
+	_transferBatch.slot = (_transferBatch.slot + 1) % (uint32_t)_transferBatch.commandBuffers.size();
+	_transferBatch.recording = VK_FALSE;
+
+	return _transferBatch.ticket++;
 }
-void VkU::DestroyBuffer(VkDevice _vkDevice, Buffer _buffer)
+void VkU::WaitTransferTicket(VkDevice _vkDevice, TransferBatch& _transferBatch, uint64_t _ticket)
+{
+	if (_ticket == _transferBatch.ticket)
+		FlushTransferBatch(_transferBatch);
+
+	for (uint32_t i = 0; i != _transferBatch.slotTickets.size(); ++i)
+	{
+		if (_transferBatch.slotTickets[i] != 0 && _transferBatch.slotTickets[i] <= _ticket)
+			ReclaimTransferBatchSlot(_vkDevice, _transferBatch, i);
+	}
+}
+void VkU::DestroyTransferBatch(VkDevice _vkDevice, TransferBatch& _transferBatch)
 {
-	VK_CHECK_CLEANUP(vkDestroyBuffer(_vkDevice, _buffer.handle, nullptr), _buffer.handle, "vkDestroyBuffer");
-	VK_CHECK_CLEANUP(vkFreeMemory(_vkDevice, _buffer.memory, nullptr), _buffer.memory, "vkFreeMemory");
+	WaitTransferTicket(_vkDevice, _transferBatch, _transferBatch.ticket);
+
+	// every slot is reclaimed, so all blocks are free
+	for (size_t i = 0; i != _transferBatch.freeStagingBlocks.size(); ++i)
+		VkU::DestroyBuffer(_vkDevice, _transferBatch.freeStagingBlocks[i].buffer);
+	_transferBatch.freeStagingBlocks.clear();
+	_transferBatch.slotStagingBlocks.clear();
+	_transferBatch.stagingBlockCount = 0;
+
+	for (size_t i = 0; i != _transferBatch.fences.size(); ++i)
+	{
+		VK_CHECK_CLEANUP(vkDestroyFence(_vkDevice, _transferBatch.fences[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _transferBatch.fences[i], "vkDestroyFence");
+	}
+	_transferBatch.fences.clear();
+	for (size_t i = 0; i != _transferBatch.semaphores.size(); ++i)
+	{
+		VK_CHECK_CLEANUP(vkDestroySemaphore(_vkDevice, _transferBatch.semaphores[i], memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _transferBatch.semaphores[i], "vkDestroySemaphore");
+	}
+	_transferBatch.semaphores.clear();
+	_transferBatch.slotTickets.clear();
+
+	// command buffers go with their pools
+	VK_CHECK_CLEANUP(vkDestroyCommandPool(_vkDevice, _transferBatch.commandPool, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _transferBatch.commandPool, "vkDestroyCommandPool");
+	if (_transferBatch.acquireCommandPool != VK_NULL_HANDLE)
+		VK_CHECK_CLEANUP(vkDestroyCommandPool(_vkDevice, _transferBatch.acquireCommandPool, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _transferBatch.acquireCommandPool, "vkDestroyCommandPool");
+	_transferBatch.commandBuffers.clear();
+	_transferBatch.acquireCommandBuffers.clear();
 }
 
-void VkU::CreateSampledImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D)
+VkU::GeometryBuffer VkU::CreateGeometryBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, uint32_t _vertexStride, uint32_t _vertexCapacity, uint32_t _indexCapacity, VkMemoryPropertyFlags _memoryPropertyFlags)
 {
-	VkImageCreateInfo imageCreateInfo;
-	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCreateInfo.pNext = nullptr;
-	imageCreateInfo.flags = 0;
-	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageCreateInfo.format = _format;
-	imageCreateInfo.extent = _extent3D;
-	imageCreateInfo.mipLevels = 1;
-	imageCreateInfo.arrayLayers = 1;
-	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCreateInfo.queueFamilyIndexCount = 0;
-	imageCreateInfo.pQueueFamilyIndices = nullptr;
-	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-	VK_CHECK_RESULT(vkCreateImage(_vkDevice, &imageCreateInfo, nullptr, &_image.handle), _image.handle, "vkCreateImage");
-	
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(_vkDevice, _image.handle, &memoryRequirements);
-	
-	VkMemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = nullptr;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &memoryAllocateInfo, nullptr, &_image.memory), _image.memory, "vkAllocateMemory");
+	VkU::GeometryBuffer geometryBuffer;
+
+	geometryBuffer.vertexBuffer = VkU::CreateVertexBuffer(_vkDevice, _physicalDevice, (VkDeviceSize)_vertexStride * _vertexCapacity, _memoryPropertyFlags);
+	geometryBuffer.indexBuffer = VkU::CreateIndexBuffer(_vkDevice, _physicalDevice, (VkDeviceSize)sizeof(uint32_t) * _indexCapacity, _memoryPropertyFlags);
+	geometryBuffer.vertexStride = _vertexStride;
+	geometryBuffer.vertexRanges.Init(_vertexCapacity);
+	geometryBuffer.indexRanges.Init(_indexCapacity);
 
-	VK_CHECK_RESULT(vkBindImageMemory(_vkDevice, _image.handle, _image.memory, 0), "????????????????", "vkBindImageMemory");
+	return geometryBuffer;
 }
-void VkU::CreateStagingImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D)
+bool VkU::AllocateMesh(GeometryBuffer& _geometryBuffer, uint32_t _vertexCount, uint32_t _indexCount, Mesh& _mesh)
+{
+	uint64_t vertexOffset;
+	if (_geometryBuffer.vertexRanges.Allocate(_vertexCount, vertexOffset) == false)
+		return false;
+
+	uint64_t firstIndex;
+	if (_geometryBuffer.indexRanges.Allocate(_indexCount, firstIndex) == false)
+	{
+		_geometryBuffer.vertexRanges.Free(vertexOffset, _vertexCount);
+		return false;
+	}
+
+	_mesh.firstIndex = (uint32_t)firstIndex;
+	_mesh.indexCount = _indexCount;
+	_mesh.vertexOffset = (int32_t)vertexOffset;
+	_mesh.vertexCount = _vertexCount;
+
+	return true;
+}
+void VkU::FreeMesh(GeometryBuffer& _geometryBuffer, Mesh _mesh)
+{
+	_geometryBuffer.vertexRanges.Free((uint64_t)_mesh.vertexOffset, _mesh.vertexCount);
+	_geometryBuffer.indexRanges.Free(_mesh.firstIndex, _mesh.indexCount);
+}
+void VkU::DestroyGeometryBuffer(VkDevice _vkDevice, GeometryBuffer& _geometryBuffer)
+{
+	VkU::DestroyBuffer(_vkDevice, _geometryBuffer.indexBuffer);
+	VkU::DestroyBuffer(_vkDevice, _geometryBuffer.vertexBuffer);
+}
+
+void VkU::CreateSampledImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D, uint32_t _mipLevelCount)
 {
 	VkImageCreateInfo imageCreateInfo;
 	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -2283,60 +3421,25 @@ void VkU::CreateStagingImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice,
 	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
 	imageCreateInfo.format = _format;
 	imageCreateInfo.extent = _extent3D;
-	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.mipLevels = _mipLevelCount;
 	imageCreateInfo.arrayLayers = 1;
 	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_LINEAR;
-	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;	// read back by TestMipmaps
 	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageCreateInfo.queueFamilyIndexCount = 0;
 	imageCreateInfo.pQueueFamilyIndices = nullptr;
 	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-	VK_CHECK_RESULT(vkCreateImage(_vkDevice, &imageCreateInfo, nullptr, &_image.handle), _image.handle, "vkCreateImage");
-
+	VK_CHECK_RESULT(vkCreateImage(_vkDevice, &imageCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_TEXTURES), &_image.handle), _image.handle, "vkCreateImage");
+	
 	VkMemoryRequirements memoryRequirements;
 	vkGetImageMemoryRequirements(_vkDevice, _image.handle, &memoryRequirements);
+	
+	VK_CHECK_RESULT(memoryPool.Allocate(memoryRequirements, VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), MemoryTracker::CATEGORY_TEXTURES, false, _image.memory), _image.memory.handle, "MemoryPool::Allocate");
 
-	VkMemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = nullptr;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = VkU::FindMemoryTypeIndex(memoryRequirements, _physicalDevice, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(_vkDevice, &memoryAllocateInfo, nullptr, &_image.memory), _image.memory, "vkAllocateMemory");
-
-	VK_CHECK_RESULT(vkBindImageMemory(_vkDevice, _image.handle, _image.memory, 0), "????????????????", "vkBindImageMemory");
-}
-void VkU::FillStagingColorImage(VkDevice _vkDevice, Image& _image, uint32_t _width, uint32_t _height, VkDeviceSize _size, void* _data)
-{
-	VkImageSubresource imageSubresource;
-	imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageSubresource.mipLevel = 0;
-	imageSubresource.arrayLayer = 0;
-
-	VkSubresourceLayout subresourceLayout;
-	vkGetImageSubresourceLayout(_vkDevice, _image.handle, &imageSubresource, &subresourceLayout);
-
-	void* vkData;
-	VK_CHECK_RESULT(vkMapMemory(_vkDevice, _image.memory, 0, _size, 0, &vkData), vkData, "vkMapMemory");
-
-	if (subresourceLayout.rowPitch == _width * 4)
-	{
-		memcpy(vkData, _data, _size);
-	}
-	else
-	{
-		uint8_t* _data8b = (uint8_t*)_data;
-		uint8_t* data8b = (uint8_t*)vkData;
-
-		for (uint32_t y = 0; y < _height; y++)
-		{
-			memcpy(&data8b[y * subresourceLayout.rowPitch], &_data8b[y * _width * 4], _width * 4);
-		}
-	}
-
-	vkUnmapMemory(_vkDevice, _image.memory);
+	VK_CHECK_RESULT(vkBindImageMemory(_vkDevice, _image.handle, _image.memory.handle, _image.memory.offset), "????????????????", "vkBindImageMemory");
 }
-void VkU::CreateColorView(VkDevice _vkDevice, Image& _image, VkFormat _format)
+void VkU::CreateColorView(VkDevice _vkDevice, Image& _image, VkFormat _format, uint32_t _mipLevelCount)
 {
 	VkImageViewCreateInfo imageViewCreateInfo;
 	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -2353,15 +3456,15 @@ void VkU::CreateColorView(VkDevice _vkDevice, Image& _image, VkFormat _format)
 	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
 	imageViewCreateInfo.subresourceRange.layerCount = 1;
 	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	imageViewCreateInfo.subresourceRange.levelCount = _mipLevelCount;
 
-	VK_CHECK_RESULT(vkCreateImageView(_vkDevice, &imageViewCreateInfo, nullptr, &_image.view), _image.view, "vkCreateImageView");
+	VK_CHECK_RESULT(vkCreateImageView(_vkDevice, &imageViewCreateInfo, memoryTracker.Callbacks(MemoryTracker::CATEGORY_TEXTURES), &_image.view), _image.view, "vkCreateImageView");
 }
 void VkU::DestroyImage(VkDevice _vkDevice, Image _image)
 {
-	VK_CHECK_CLEANUP(vkDestroyImageView(_vkDevice, _image.view, nullptr), _image.view, "vkDestroyImageView");
-	VK_CHECK_CLEANUP(vkDestroyImage(_vkDevice, _image.handle, nullptr), _image.handle, "vkDestroyBuffer");
-	VK_CHECK_CLEANUP(vkFreeMemory(_vkDevice, _image.memory, nullptr), _image.memory, "vkFreeMemory");
+	VK_CHECK_CLEANUP(vkDestroyImageView(_vkDevice, _image.view, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _image.view, "vkDestroyImageView");
+	VK_CHECK_CLEANUP(vkDestroyImage(_vkDevice, _image.handle, memoryTracker.Callbacks(MemoryTracker::CATEGORY_OTHER)), _image.handle, "vkDestroyBuffer");
+	VK_CHECK_CLEANUP(memoryPool.Free(_image.memory), _image.memory.handle, "MemoryPool::Free");
 }
 
 void VkU::WaitFence(VkDevice _vkDevice, uint32_t _fenceCount, VkFence * _fences, VkBool32 _waitAll, uint64_t _timeout)
@@ -2400,8 +3503,179 @@ void VkU::LoadShader(const char* _filename, size_t& _fileSize, char** _buffer)
 
 	file.close();
 }
+VkU::MappedFile VkU::MapFile(const char* _filename)
+{
+	MappedFile mappedFile = { INVALID_HANDLE_VALUE, NULL, nullptr, 0 };
+
+	mappedFile.file = CreateFileA(_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mappedFile.file == INVALID_HANDLE_VALUE)
+		return mappedFile;
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(mappedFile.file, &fileSize) == FALSE || fileSize.QuadPart == 0)
+	{
+		UnmapFile(mappedFile);
+		return mappedFile;
+	}
+
+	mappedFile.mapping = CreateFileMappingA(mappedFile.file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappedFile.mapping != NULL)
+		mappedFile.data = (const uint8_t*)MapViewOfFile(mappedFile.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mappedFile.data == nullptr)
+	{
+		UnmapFile(mappedFile);
+		return mappedFile;
+	}
+
+	mappedFile.size = (uint64_t)fileSize.QuadPart;
+	return mappedFile;
+}
+void VkU::UnmapFile(MappedFile& _mappedFile)
+{
+	if (_mappedFile.data != nullptr)
+		UnmapViewOfFile(_mappedFile.data);
+	if (_mappedFile.mapping != NULL)
+		CloseHandle(_mappedFile.mapping);
+	if (_mappedFile.file != INVALID_HANDLE_VALUE)
+		CloseHandle(_mappedFile.file);
+
+	_mappedFile = { INVALID_HANDLE_VALUE, NULL, nullptr, 0 };
+}
+uint64_t VkU::HashData(const uint8_t* _data, uint64_t _size)
+{
+	// 64 bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (uint64_t i = 0; i != _size; ++i)
+	{
+		hash ^= _data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+bool VkU::ReadMeshCache(const char* _filename, uint64_t _sourceHash, uint32_t _postProcessSteps, Meshes& _meshes)
+{
+	PROFILE_ZONE("VkU::ReadMeshCache");
+
+	std::string cacheFilename = std::string(_filename) + MESH_CACHE_EXTENSION;
+	MappedFile cache = MapFile(cacheFilename.c_str());
+	if (cache.data == nullptr)
+		return false;
+
+	// validate
+	const MeshCacheHeader* header = (const MeshCacheHeader*)cache.data;
+	bool valid = cache.size >= sizeof(MeshCacheHeader);
+	if (valid)
+		valid = header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION && header->sourceHash == _sourceHash && header->postProcessSteps == _postProcessSteps;
+	if (valid)
+		valid = sizeof(MeshCacheHeader) + header->meshCount * sizeof(Meshes::MeshProperties) <= cache.size
+			&& header->vertexDataOffset <= cache.size && header->vertexSize <= cache.size - header->vertexDataOffset
+			&& header->indexDataOffset <= cache.size && header->indexSize <= cache.size - header->indexDataOffset;
+	if (valid == false)
+	{
+		UnmapFile(cache);
+		return false;
+	}
+
+	// copy out
+	const Meshes::MeshProperties* meshProperties = (const Meshes::MeshProperties*)(cache.data + sizeof(MeshCacheHeader));
+	_meshes.meshProperties.assign(meshProperties, meshProperties + header->meshCount);
+
+	_meshes.vertexStride = header->vertexStride;
+	_meshes.vertexSize = header->vertexSize;
+	_meshes.vertexData = new uint8_t[_meshes.vertexSize];
+	memcpy(_meshes.vertexData, cache.data + header->vertexDataOffset, _meshes.vertexSize);
+
+	_meshes.indexSize = header->indexSize;
+	_meshes.indexData = new uint8_t[_meshes.indexSize];
+	memcpy(_meshes.indexData, cache.data + header->indexDataOffset, _meshes.indexSize);
+
+	UnmapFile(cache);
+	return true;
+}
+void VkU::WriteMeshCache(const char* _filename, uint64_t _sourceHash, uint32_t _postProcessSteps, const Meshes& _meshes)
+{
+	PROFILE_ZONE("VkU::WriteMeshCache");
+
+	// data sections start 16 byte aligned
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = _sourceHash;
+	header.postProcessSteps = _postProcessSteps;
+	header.meshCount = (uint32_t)_meshes.meshProperties.size();
+	header.vertexStride = _meshes.vertexStride;
+	header.vertexSize = _meshes.vertexSize;
+	header.vertexDataOffset = (sizeof(MeshCacheHeader) + header.meshCount * sizeof(Meshes::MeshProperties) + 15) & ~15ull;
+	header.indexSize = _meshes.indexSize;
+	header.indexDataOffset = (header.vertexDataOffset + header.vertexSize + 15) & ~15ull;
+
+	// written aside and moved over the old cache, so a reader never maps a partial file
+	std::string cacheFilename = std::string(_filename) + MESH_CACHE_EXTENSION;
+	std::string temporaryFilename = cacheFilename + '.' + std::to_string(GetCurrentThreadId());
+
+	FILE* file = fopen(temporaryFilename.c_str(), "wb");
+	bool written = file != NULL;
+	if (written)
+	{
+		const uint8_t padding[16] = {};
+		uint64_t propertiesEnd = sizeof(MeshCacheHeader) + header.meshCount * sizeof(Meshes::MeshProperties);
+		uint64_t vertexEnd = header.vertexDataOffset + header.vertexSize;
+
+		written = fwrite(&header, sizeof(header), 1, file) == 1;
+		if (written && header.meshCount != 0)
+			written = fwrite(_meshes.meshProperties.data(), sizeof(Meshes::MeshProperties), header.meshCount, file) == header.meshCount;
+		if (written && header.vertexDataOffset != propertiesEnd)
+			written = fwrite(padding, (size_t)(header.vertexDataOffset - propertiesEnd), 1, file) == 1;
+		if (written && header.vertexSize != 0)
+			written = fwrite(_meshes.vertexData, (size_t)header.vertexSize, 1, file) == 1;
+		if (written && header.indexDataOffset != vertexEnd)
+			written = fwrite(padding, (size_t)(header.indexDataOffset - vertexEnd), 1, file) == 1;
+		if (written && header.indexSize != 0)
+			written = fwrite(_meshes.indexData, (size_t)header.indexSize, 1, file) == 1;
+
+		written = fclose(file) == 0 && written;
+	}
+	if (written)
+		written = MoveFileExA(temporaryFilename.c_str(), cacheFilename.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+
+	if (written == false)
+	{
+		DeleteFileA(temporaryFilename.c_str());
+#if _DEBUG
+		logger << "WARNING: MESH CACHE \"" << cacheFilename << "\" could not be written. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
+#endif
+	}
+}
 void VkU::LoadModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _aiPostProcessSteps)
 {
+	// forces meshes to be triangulated
+	if ((_aiPostProcessSteps & aiProcess_Triangulate) != aiProcess_Triangulate)
+		_aiPostProcessSteps = (aiPostProcessSteps)(_aiPostProcessSteps | aiProcess_Triangulate);
+
+#ifdef MESH_CACHE
+	// the cache is keyed on the model's content, not its time stamp
+	MappedFile source = MapFile(_filename);
+	if (source.data != nullptr)
+	{
+		uint64_t sourceHash = HashData(source.data, source.size);
+		UnmapFile(source);
+
+		if (ReadMeshCache(_filename, sourceHash, (uint32_t)_aiPostProcessSteps, _meshes))
+			return;
+
+		ImportModel(_filename, _meshes, _aiPostProcessSteps);
+		WriteMeshCache(_filename, sourceHash, (uint32_t)_aiPostProcessSteps, _meshes);
+		return;
+	}
+#endif
+
+	ImportModel(_filename, _meshes, _aiPostProcessSteps);
+}
+void VkU::ImportModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _aiPostProcessSteps)
+{
+	PROFILE_ZONE("VkU::ImportModel");
+
 	Assimp::Importer Importer;
 	const aiScene* pScene;
 
@@ -2483,6 +3757,7 @@ void VkU::LoadModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _
 		singleVertexSize += sizeof(float) * 6;
 
 	_meshes.vertexSize *= singleVertexSize;
+	_meshes.vertexStride = singleVertexSize;
 
 	// allocate buffers
 	_meshes.indexData = new uint8_t[_meshes.indexSize];
@@ -2552,6 +3827,166 @@ void VkU::LoadModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _
 
 	int ii = 0;
 }
+uint32_t VkU::GetMipLevelCount(uint32_t _width, uint32_t _height)
+{
+	uint32_t mipLevelCount = 1;
+	for (uint32_t size = _width > _height ? _width : _height; size > 1; size /= 2)
+		++mipLevelCount;
+
+	return mipLevelCount;
+}
+VkExtent2D VkU::GetMipLevelExtent(uint32_t _width, uint32_t _height, uint32_t _mipLevel)
+{
+	VkExtent2D extent;
+	extent.width = _width >> _mipLevel != 0 ? _width >> _mipLevel : 1;
+	extent.height = _height >> _mipLevel != 0 ? _height >> _mipLevel : 1;
+
+	return extent;
+}
+VkDeviceSize VkU::GetMipLevelOffset(uint32_t _width, uint32_t _height, uint8_t _texelSize, uint32_t _mipLevel)
+{
+	VkDeviceSize alignment = _texelSize * 4;
+	VkDeviceSize offset = 0;
+	for (uint32_t level = 0; level != _mipLevel; ++level)
+	{
+		VkExtent2D extent = GetMipLevelExtent(_width, _height, level);
+		VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * _texelSize;
+		offset += (size + alignment - 1) / alignment * alignment;
+	}
+
+	return offset;
+}
+void VkU::DownsampleBox(const uint8_t* _source, uint32_t _width, uint32_t _height, uint8_t _texelSize, uint8_t* _destination)
+{
+	VkExtent2D extent = GetMipLevelExtent(_width, _height, 1);
+	uint32_t width = extent.width;
+	uint32_t height = extent.height;
+	uint64_t sourceRowSize = (uint64_t)_width * _texelSize;
+	uint32_t sourceStep = _width > 1 ? _texelSize : 0;	// a one texel wide level averages its texel with itself
+
+	for (uint32_t y = 0; y != height; ++y)
+	{
+		const uint8_t* row0 = _source + 2 * y * sourceRowSize;
+		const uint8_t* row1 = _height > 1 ? row0 + sourceRowSize : row0;
+		uint8_t* destination = _destination + (uint64_t)y * width * _texelSize;
+
+		uint32_t x = 0;
+		// 8 source texels of both rows to 4 destination texels, summed in 16 bits per channel
+		if (_texelSize == 4 && _width > 1)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i rounding = _mm_set1_epi16(2);
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+				__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+				__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+				__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+				// vertical sums of texels 0 1, 2 3, 4 5 and 6 7
+				__m128i sum01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				__m128i sum23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				__m128i sum45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				__m128i sum67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+				// horizontal pairs
+				__m128i low = _mm_add_epi16(_mm_unpacklo_epi64(sum01, sum23), _mm_unpackhi_epi64(sum01, sum23));
+				__m128i high = _mm_add_epi16(_mm_unpacklo_epi64(sum45, sum67), _mm_unpackhi_epi64(sum45, sum67));
+
+				low = _mm_srli_epi16(_mm_add_epi16(low, rounding), 2);
+				high = _mm_srli_epi16(_mm_add_epi16(high, rounding), 2);
+				_mm_storeu_si128((__m128i*)(destination + x * 4), _mm_packus_epi16(low, high));
+			}
+		}
+
+		for (; x != width; ++x)
+		{
+			const uint8_t* texel0 = row0 + 2 * x * _texelSize;
+			const uint8_t* texel1 = row1 + 2 * x * _texelSize;
+			for (uint32_t c = 0; c != _texelSize; ++c)
+				destination[x * _texelSize + c] = (uint8_t)((texel0[c] + texel0[c + sourceStep] + texel1[c] + texel1[c + sourceStep] + 2) >> 2);
+		}
+	}
+}
+void VkU::GenerateMipChain(ImageData& _image)
+{
+	if (_image.data == nullptr)
+		return;
+
+	uint8_t texelSize = _image.channelCount * _image.bytesPerChannel;
+	uint32_t mipLevelCount = GetMipLevelCount(_image.width, _image.height);
+
+	uint8_t* data = new uint8_t[GetMipLevelOffset(_image.width, _image.height, texelSize, mipLevelCount)];
+	memcpy(data, _image.data, (size_t)_image.width * _image.height * texelSize);
+	for (uint32_t level = 1; level != mipLevelCount; ++level)
+	{
+		VkExtent2D extent = GetMipLevelExtent(_image.width, _image.height, level - 1);
+		DownsampleBox(data + GetMipLevelOffset(_image.width, _image.height, texelSize, level - 1), extent.width, extent.height, texelSize, data + GetMipLevelOffset(_image.width, _image.height, texelSize, level));
+	}
+
+	delete[] (uint8_t*)_image.data;
+	_image.data = data;
+	_image.mipLevelCount = mipLevelCount;
+}
+bool VkU::DecodeRLE(const uint8_t* _source, uint64_t _sourceSize, uint8_t _pixelSize, uint64_t _pixelCount, uint8_t* _destination)
+{
+	const uint8_t* sourceEnd = _source + _sourceSize;
+	uint8_t* destinationEnd = _destination + _pixelCount * _pixelSize;
+
+	while (_destination != destinationEnd)
+	{
+		if (_source == sourceEnd)
+			return false;
+
+		// packet header, the high bit marks a run of one repeated pixel, the low bits hold the pixel count - 1
+		uint8_t packet = *_source++;
+		uint64_t packetSize = (uint64_t)((packet & 0x7F) + 1) * _pixelSize;
+		if (packetSize > (uint64_t)(destinationEnd - _destination))
+			return false;
+
+		// raw
+		if ((packet & 0x80) == 0)
+		{
+			if (packetSize > (uint64_t)(sourceEnd - _source))
+				return false;
+
+			memcpy(_destination, _source, packetSize);
+			_source += packetSize;
+			_destination += packetSize;
+			continue;
+		}
+
+		// run
+		if (_pixelSize > (uint64_t)(sourceEnd - _source))
+			return false;
+
+		if (packetSize < 16 * _pixelSize)
+		{
+			for (uint8_t* runEnd = _destination + packetSize; _destination != runEnd; _destination += _pixelSize)
+				memcpy(_destination, _source, _pixelSize);
+		}
+		else
+		{
+			// 16 pixels are a whole number of 16 byte stores for 3 and 4 byte pixels
+			alignas(16) uint8_t pattern[16 * 4];
+			for (uint32_t i = 0; i != 16; ++i)
+				memcpy(pattern + i * _pixelSize, _source, _pixelSize);
+
+			uint32_t storeCount = _pixelSize;
+			uint8_t* runEnd = _destination + packetSize;
+			for (; (uint64_t)(runEnd - _destination) >= 16u * _pixelSize; _destination += 16 * _pixelSize)
+			{
+				for (uint32_t i = 0; i != storeCount; ++i)
+					_mm_storeu_si128((__m128i*)(_destination + i * 16), _mm_load_si128((const __m128i*)(pattern + i * 16)));
+			}
+			memcpy(_destination, pattern, runEnd - _destination);
+			_destination = runEnd;
+		}
+		_source += _pixelSize;
+	}
+
+	return true;
+}
 void VkU::LoadImageTGA(const char * _filename, uint32_t & _width, uint32_t & _height, uint8_t & _channelCount, uint8_t & _bytesPerChannel, void*& _data)
 {
 	_width = 0;
@@ -2562,92 +3997,95 @@ void VkU::LoadImageTGA(const char * _filename, uint32_t & _width, uint32_t & _he
 		delete[] _data;
 	_data = nullptr;
 
-	uint8_t header[12];
-
-	FILE* fTGA;
-	fTGA = fopen(_filename, "rb");
-
-	uint8_t cTGAcompare[12] = { 0,0,10,0,0,0,0,0,0,0,0,0 };
-	uint8_t uTGAcompare[12] = { 0,0, 2,0,0,0,0,0,0,0,0,0 };
-
-	if (fTGA == NULL)
+	// mapped, so uncompressed texels are copied once and compressed ones are decoded straight from the file
+	MappedFile file = MapFile(_filename);
+	if (file.data == nullptr)
 	{
 #if _DEBUG
 		logger << "ERROR: TGA \"" << _filename << "\" missing. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
 		assert(0);
 #endif
+		return;
 	}
 
-	if (fread(&header, sizeof(header), 1, fTGA) == 0)
-		return;
-	if (memcmp(cTGAcompare, &header, sizeof(header)) == 0)
+	// header, true color without color map, uncompressed (2) or run length encoded (10)
+	const uint8_t* header = file.data;
+	if (file.size < 18 || header[1] != 0 || (header[2] != 2 && header[2] != 10))
 	{
-		// TODO: Load Compressed
+		UnmapFile(file);
 #if _DEBUG
-		logger << "ERROR: TGA compressed \"" << _filename << "\" not supported. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
+		logger << "ERROR: TGA header \"" << _filename << "\" contains invalid data. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
 		assert(0);
 #endif
+		return;
 	}
-	else if (memcmp(uTGAcompare, &header, sizeof(header)) == 0)
-	{
-		uint8_t header[6];
 
-		if (fread(header, sizeof(header), 1, fTGA) == 0)
-			return;
+	bool compressed = header[2] == 10;
+	bool bottomUp = (header[17] & 0x20) == 0;
+	uint32_t width = header[13] * 256 + header[12];
+	uint32_t height = header[15] * 256 + header[14];
+	uint8_t bpp = header[16];
 
-		_width = header[1] * 256 + header[0];
-		_height = header[3] * 256 + header[2];
-		uint8_t bpp = header[4];
-
-		if (_width == 0 || _height == 0 || (bpp != 24 && bpp != 32))
-		{
+	if (width == 0 || height == 0 || (bpp != 24 && bpp != 32))
+	{
+		UnmapFile(file);
 #if _DEBUG
-			logger << "ERROR: TGA uncompressed \"" << _filename << "\" contains invalid data (width = " << _width << ", height = " << _height << ", bpp = " << bpp << "). Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
-			assert(0);
+		logger << "ERROR: TGA \"" << _filename << "\" contains invalid data (width = " << width << ", height = " << height << ", bpp = " << (uint32_t)bpp << "). Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
+		assert(0);
 #endif
-		}
+		return;
+	}
 
-		if (bpp == 24)
-		{
-			_channelCount = 3;
-			_bytesPerChannel = 1;
-		}
-		else if (bpp == 32)
-		{
-			_channelCount = 4;
-			_bytesPerChannel = 1;
-		}
+	uint8_t pixelSize = bpp / 8;
+	uint64_t rowSize = (uint64_t)width * pixelSize;
+	uint64_t size = rowSize * height;
 
-		size_t size = _channelCount * _bytesPerChannel * _width * _height;
+	// texels follow the image ID
+	uint64_t texelsOffset = 18 + header[0];
+	const uint8_t* texels = file.data + texelsOffset;
+	uint64_t texelsSize = file.size > texelsOffset ? file.size - texelsOffset : 0;
 
-		_data = new uint8_t[size];
-		if (fread(_data, 1, size, fTGA) != size)
-		{
-			_width = 0;
-			_height = 0;
-			_channelCount = 0;
-			_bytesPerChannel = 0;
-			delete[] _data;
-			_data = nullptr;
-#if _DEBUG
-			logger << "ERROR: TGA \"" << _filename << "\" failed to fread. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
-			assert(0);
-#endif
-			return;
-		}
+	uint8_t* data = new uint8_t[size];
+	bool decoded;
+	if (compressed)
+	{
+		decoded = DecodeRLE(texels, texelsSize, pixelSize, (uint64_t)width * height, data);
 	}
 	else
 	{
-		_width = 0;
-		_height = 0;
-		_channelCount = 0;
-		_bytesPerChannel = 0;
-		delete[] _data;
-		_data = nullptr;
+		decoded = texelsSize >= size;
+		if (decoded)
+			memcpy(data, texels, size);
+	}
+	UnmapFile(file);
+
+	if (decoded == false)
+	{
+		delete[] data;
 #if _DEBUG
-		logger << "ERROR: TGA header \"" << _filename << "\" contains invalid data. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
+		logger << "ERROR: TGA \"" << _filename << "\" is truncated. Time: " << Engine::timer.GetTime() << " file = " << __FILE__ << "line = " << __LINE__ << '\n';
 		assert(0);
 #endif
 		return;
 	}
+
+	// rows are kept top to bottom, the order textures are sampled in
+	if (bottomUp)
+	{
+		std::vector<uint8_t> row(rowSize);
+		for (uint32_t y = 0; y != height / 2; ++y)
+		{
+			uint8_t* top = data + y * rowSize;
+			uint8_t* bottom = data + (height - 1 - y) * rowSize;
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+
+	_width = width;
+	_height = height;
+	_channelCount = pixelSize;
+	_bytesPerChannel = 1;
+	_data = data;
 }
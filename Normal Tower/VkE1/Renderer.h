@@ -18,42 +18,56 @@
 #include <assimp/Importer.hpp>
 
 #include "Logger.h"
+#include "Profiler.h"
+#include "FrameStatistics.h"
+#include "DebugReportSink.h"
+#include "MemoryTracker.h"
+#include "MemoryPool.h"
+#include "DirtyArray.h"
+#include "RangeAllocator.h"
+#include "WorkerPool.h"
 
 static VkResult vkResult;
+static MemoryTracker memoryTracker;
+static MemoryPool memoryPool;
 
-#if _DEBUG
-static Logger logger;
-static Logger debugReportCallbackLogger;
-static Logger cleanUpLogger;
+//#define VK_CALL_TRACE
+
+#if _DEBUG || defined(VK_CALL_TRACE)
+#include "CallTrace.h"
 
-#define VK_CHECK_RESULT(call, variable, callName) vkResult = call;	\
-logger << "Result: " << vkResult << "	Value: " << variable << "	Time: " << Engine::timer.GetTime() << "	Call: " << callName << '\n'
-#define VK_CHECK_CLEANUP(call, variable, callName) call;	\
-cleanUpLogger << "Value: " << variable << "	Time: " << Engine::timer.GetTime() << "	Call: " << callName << '\n'; \
-variable = VK_NULL_HANDLE
+static CallTrace callTrace;
+
+#define VK_CHECK_RESULT(call, variable, callName) do {	\
+static const uint32_t callSite = callTrace.RegisterCallSite(callName, __FILE__, __LINE__);	\
+uint64_t callStart = callTrace.Now();	\
+vkResult = call;	\
+callTrace.Add(callSite, vkResult, CallTrace::Handle(variable), callStart, callTrace.Now()); } while (0)
+#define VK_CHECK_CLEANUP(call, variable, callName) do {	\
+static const uint32_t callSite = callTrace.RegisterCallSite(callName, __FILE__, __LINE__);	\
+uint64_t callHandle = CallTrace::Handle(variable);	\
+uint64_t callStart = callTrace.Now();	\
+call;	\
+callTrace.Add(callSite, VK_SUCCESS, callHandle, callStart, callTrace.Now());	\
+variable = VK_NULL_HANDLE; } while (0)
 
 #else
 #define VK_CHECK_RESULT(call, variable, callName) vkResult = call
 #define VK_CHECK_CLEANUP(call, variable, callName) call
 #endif
 
+#if _DEBUG
+static Logger logger;
+static Logger debugReportCallbackLogger;
+static DebugReportSink debugReportSink;
+#endif
+
 namespace VkU
 {
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugReportCallback(VkDebugReportFlagsEXT _flags, VkDebugReportObjectTypeEXT _objType, uint64_t _obj, size_t _location, int32_t _code, const char* _layerPrefix, const char* _msg, void* _userData)
 	{
 #if _DEBUG
-		if (_flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT)
-			debugReportCallbackLogger << "	INFORMATION:";
-		if (_flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
-			debugReportCallbackLogger << "WARNING:";
-		if (_flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
-			debugReportCallbackLogger << "PERFORMANCE:";
-		if (_flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
-			debugReportCallbackLogger << "ERROR:";
-		if (_flags & VK_DEBUG_REPORT_DEBUG_BIT_EXT)
-			debugReportCallbackLogger << "	DEBUG:";
-
-		debugReportCallbackLogger << _msg << '\n';
+		debugReportSink.Add(_flags, _code, _layerPrefix, _msg);
 #endif
 		return VK_FALSE; // Don't abort the function that made this call
 	}
@@ -113,6 +127,13 @@ namespace VkU
 		VkCompositeAlphaFlagBitsKHR	compositeAlpha;
 		VkPresentModeKHR			presentMode;
 	};
+	// How the host can write memory the device reads at full speed.
+	enum MEMORY_TOPOLOGY
+	{
+		MEMORY_TOPOLOGY_DISCRETE,		// device local memory is not host visible, or only through the small BAR window
+		MEMORY_TOPOLOGY_RESIZABLE_BAR,	// a device local heap is host visible as a whole
+		MEMORY_TOPOLOGY_UNIFIED,		// every heap is device local and one memory type is host visible as well
+	};
 	struct Queue
 	{
 		std::vector<VkQueue>	handles;
@@ -139,7 +160,7 @@ namespace VkU
 	struct Image
 	{
 		VkImage handle;
-		VkDeviceMemory memory;
+		MemoryPool::Allocation memory;
 		VkImageView view;
 	};
 	struct Swapchain
@@ -156,7 +177,59 @@ namespace VkU
 	struct Buffer
 	{
 		VkBuffer handle;
-		VkDeviceMemory memory;
+		MemoryPool::Allocation memory;
+	};
+	struct StagingRegion
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		uint8_t* data;
+	};
+	// One buffer to image copy of EnqueueBufferToImageCopies, the buffer holds mipLevelCount levels laid out as GetMipLevelOffset describes.
+	struct ImageCopy
+	{
+		VkBuffer srcBuffer;
+		VkDeviceSize srcOffset;
+		Image dstImage;
+		VkExtent3D extent3D;
+		uint8_t texelSize;
+		uint32_t mipLevelCount;
+	};
+	// Staging memory of a transfer batch, handed out linearly and rewound once the batch using it completed.
+	struct StagingBlock
+	{
+		Buffer buffer;
+		VkDeviceSize size;
+		VkDeviceSize head;
+	};
+	// Transfers are recorded into the command buffer of the current slot as they are
+	// enqueued and submitted together, with one fence, by FlushTransferBatch. Each
+	// submitted batch is identified by a ticket, tickets grow by one per batch.
+	// On a queue of another family than the consumer, every transfer releases its
+	// resource and a second command buffer acquires it on the consumer's queue, after
+	// the slot's semaphore. The fence is signaled by the acquiring submit.
+	struct TransferBatch
+	{
+		VkQueue queue;
+		uint32_t queueFamilyIndex;
+		VkQueue acquireQueue;
+		uint32_t acquireQueueFamilyIndex;
+		VkBool32 ownershipTransfer;	// the families differ
+
+		VkCommandPool commandPool;
+		VkCommandPool acquireCommandPool;	// VK_NULL_HANDLE without ownership transfer
+		std::vector<VkCommandBuffer> commandBuffers;	// one per slot
+		std::vector<VkCommandBuffer> acquireCommandBuffers;
+		std::vector<VkSemaphore> semaphores;
+		std::vector<VkFence> fences;
+		std::vector<uint64_t> slotTickets;	// batch in flight from each slot, 0 when the slot is free
+		std::vector<std::vector<StagingBlock>> slotStagingBlocks;	// read by each slot's batch, free again once it completed
+		std::vector<StagingBlock> freeStagingBlocks;
+		uint32_t stagingBlockCount;	// created, blocks are kept until the batch is destroyed
+		uint32_t slot;		// slot being recorded
+		VkBool32 recording;
+		uint64_t ticket;	// of the batch being recorded
+		uint64_t copyCount;	// enqueued since creation
 	};
 	struct ShaderModule
 	{
@@ -165,6 +238,22 @@ namespace VkU
 		const char*				entryPointName;
 	};
 
+	struct FrameQueries
+	{
+		VkQueryPool	timestamps;
+		VkQueryPool	pipelineStatistics;
+		VkBool32	pending;	// written by a submitted frame and not read back yet
+		uint64_t	submitTime;	// profiler time of that submit
+	};
+	struct GpuStatistics
+	{
+		double renderPassTime;	// seconds
+		double drawTimes[3];	// seconds, model 0, model 1 and every model added after them
+		uint64_t vertexInvocations;
+		uint64_t clippingPrimitives;
+		uint64_t fragmentInvocations;
+	};
+
 	enum VERTEX_ATTRIBUTES
 	{
 		POS2 = 1,
@@ -232,15 +321,74 @@ namespace VkU
 
 		uint64_t indexSize;
 		uint8_t* indexData;
+
+		uint64_t vertexStride;
+	};
+
+	// Decoded texels of LoadImageTGA, data is allocated with new[] and holds mipLevelCount levels laid out as GetMipLevelOffset describes.
+	struct ImageData
+	{
+		uint32_t width;
+		uint32_t height;
+		uint8_t channelCount;
+		uint8_t bytesPerChannel;
+		void* data;
+		uint32_t mipLevelCount;
+	};
+
+	// Header of the binary cache LoadModel keeps next to each model (filename + MESH_CACHE_EXTENSION). It is followed
+	// by meshCount MeshProperties, the vertex data at vertexDataOffset and the index data at indexDataOffset.
+	#define MESH_CACHE_EXTENSION ".meshcache"
+	struct MeshCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;	// of the model file's content
+		uint32_t postProcessSteps;
+		uint32_t meshCount;
+		uint64_t vertexStride;
+		uint64_t vertexSize;
+		uint64_t vertexDataOffset;
+		uint64_t indexSize;
+		uint64_t indexDataOffset;
+	};
+	// A read only view of a whole file, data is nullptr when it could not be mapped.
+	struct MappedFile
+	{
+		HANDLE file;
+		HANDLE mapping;
+		const uint8_t* data;
+		uint64_t size;
+	};
+
+	// What vkCmdDrawIndexed needs to draw one model out of the geometry buffer.
+	struct Mesh
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t vertexOffset;
+		uint32_t vertexCount;
+	};
+	// One vertex and one index buffer every mesh is sub-allocated from, so they are bound once per frame.
+	// The vertex ranges count vertices of vertexStride bytes, the index ranges uint32_t indices.
+	struct GeometryBuffer
+	{
+		Buffer vertexBuffer;
+		Buffer indexBuffer;
+		uint32_t vertexStride;
+		RangeAllocator vertexRanges;
+		RangeAllocator indexRanges;
 	};
 
 	VkFormat GetDepthFormat(VkPhysicalDevice _physicalDevices, std::vector<VkFormat>* _preferedDepthFormat);
 
-	Window GetWindow(uint32_t _width, uint32_t _height, const char * _title, const char * _name, WNDPROC _wndProc);
+	Window GetWindow(uint32_t _width, uint32_t _height, const char * _title, const char * _name, WNDPROC _wndProc, bool _visible = true);
 
 	bool CheckQueueFamilyIndexSupport(uint32_t _familyIndex, PhysicalDevice _physicalDevice, VkSurfaceKHR _surface, VkQueueFlags _flags, VkBool32 _presentability, uint32_t _count);
 	std::vector<uint32_t> GetQueueFamilyIndicesWithSupport(Queue _deviceQueue, PhysicalDevice _physicalDevice, std::vector<Surface> _surfaces);
 	bool PickDeviceQueuesIndicesRecursively(std::vector<uint32_t>& _queueFamilyUseCount, std::vector<std::vector<uint32_t>> _deviceQueuesValidIndices, std::vector<VkQueueFamilyProperties> _queueFamilyProperties, std::vector<std::array<uint32_t, 3>>& _queueFamily_Indices_Count, size_t _depth);
+	// (uint32_t)-1 when no family has _flags without any of _excludedFlags.
+	uint32_t FindDedicatedQueueFamilyIndex(PhysicalDevice _physicalDevice, VkQueueFlags _flags, VkQueueFlags _excludedFlags);
 	std::vector<Queue> PickDeviceQueuesIndices(std::vector<Queue> _queues, PhysicalDevice _physicalDevice, std::vector<Surface> _surfaces, bool * _isCompatible);
 
 	std::vector<VkSurfaceFormatKHR> GetVkSurfaceFormatKHRs(VkPhysicalDevice _physicalDevice, VkSurfaceKHR _surface);
@@ -253,19 +401,45 @@ namespace VkU
 	VkPresentModeKHR GetVkPresentModeKHR(VkPhysicalDevice _physicalDevice, VkSurfaceKHR _surface, std::vector<VkPresentModeKHR>* _preferedPresentModes);
 
 	static uint32_t FindMemoryTypeIndex(VkMemoryRequirements _memoryRequirements, PhysicalDevice _physicalDevice, VkMemoryPropertyFlags _memoryPropertyFlags);
+	static MEMORY_TOPOLOGY GetMemoryTopology(PhysicalDevice _physicalDevice);
 
 	static Buffer CreateUniformBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size);
-	static Buffer CreateVertexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size);
-	static Buffer CreateIndexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size);
+	static Buffer CreateHostUniformBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	static Buffer CreateHostStorageBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	// Host visible _memoryPropertyFlags leave the buffer mapped, to be written in place instead of through a staging copy.
+	static Buffer CreateVertexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	static Buffer CreateIndexBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size, VkMemoryPropertyFlags _memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	static Buffer CreateStagingBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, VkDeviceSize _size);
 	static void FillStagingBuffer(VkDevice _vkDevice, Buffer _stagingBuffer, VkDeviceSize _size, void* _data);
-	static void TransferStagingBuffer(Device _device, VkCommandBuffer _commandBuffer, VkFence& _fence, Buffer _stagingBuffer, Buffer _dstBuffer, VkDeviceSize _size);
 	static void DestroyBuffer(VkDevice _vkDevice, Buffer _buffer);
 
-	static void CreateSampledImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D);
-	static void CreateStagingImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D);
-	static void FillStagingColorImage(VkDevice _vkDevice, Image& _image, uint32_t _width, uint32_t _height, VkDeviceSize _size, void* _data);
-	static void CreateColorView(VkDevice _vkDevice, Image& _image, VkFormat _format);
+	// Transfers run on _queue, their results are used on _acquireQueue. Creates its own command pools.
+	static TransferBatch CreateTransferBatch(VkDevice _vkDevice, Queue _queue, Queue _acquireQueue, uint32_t _slotCount);
+	// Waits for the batch in flight from _slot and returns its staging blocks.
+	static void ReclaimTransferBatchSlot(VkDevice _vkDevice, TransferBatch& _transferBatch, uint32_t _slot);
+	// Begins the current slot's command buffer when nothing is recorded yet, waiting for the slot's previous batch first.
+	static VkCommandBuffer RecordTransferBatch(VkDevice _vkDevice, TransferBatch& _transferBatch);
+	// The enqueue functions return the ticket the transfer completes with.
+	static uint64_t EnqueueBufferCopy(VkDevice _vkDevice, TransferBatch& _transferBatch, VkBuffer _srcBuffer, VkDeviceSize _srcOffset, Buffer _dstBuffer, VkDeviceSize _dstOffset, VkDeviceSize _size, VkPipelineStageFlags _dstStageMask, VkAccessFlags _dstAccessMask);
+	// Leaves the images in SHADER_READ_ONLY_OPTIMAL. All images are transitioned by one barrier before the copies and one after.
+	static uint64_t EnqueueBufferToImageCopies(VkDevice _vkDevice, TransferBatch& _transferBatch, uint32_t _imageCopyCount, const ImageCopy* _imageCopies);
+	// Staging memory for the batch being recorded, begins recording when nothing is. Regions larger than a block get
+	// a block of their own, which is kept for reuse like the others. _alignment does not need to be a power of two.
+	static StagingRegion AllocateTransferStaging(VkDevice _vkDevice, PhysicalDevice _physicalDevice, TransferBatch& _transferBatch, VkDeviceSize _size, VkDeviceSize _alignment);
+	// Submits what was recorded, returns the ticket of the last submitted batch.
+	static uint64_t FlushTransferBatch(TransferBatch& _transferBatch);
+	// Flushes first if _ticket is still being recorded.
+	static void WaitTransferTicket(VkDevice _vkDevice, TransferBatch& _transferBatch, uint64_t _ticket);
+	static void DestroyTransferBatch(VkDevice _vkDevice, TransferBatch& _transferBatch);
+
+	static GeometryBuffer CreateGeometryBuffer(VkDevice _vkDevice, PhysicalDevice _physicalDevice, uint32_t _vertexStride, uint32_t _vertexCapacity, uint32_t _indexCapacity, VkMemoryPropertyFlags _memoryPropertyFlags);
+	// Returns false when either buffer has no free range large enough, _mesh is left untouched then.
+	static bool AllocateMesh(GeometryBuffer& _geometryBuffer, uint32_t _vertexCount, uint32_t _indexCount, Mesh& _mesh);
+	static void FreeMesh(GeometryBuffer& _geometryBuffer, Mesh _mesh);
+	static void DestroyGeometryBuffer(VkDevice _vkDevice, GeometryBuffer& _geometryBuffer);
+
+	static void CreateSampledImage(VkDevice _vkDevice, PhysicalDevice _physicalDevice, Image& _image, VkFormat _format, VkExtent3D _extent3D, uint32_t _mipLevelCount = 1);
+	static void CreateColorView(VkDevice _vkDevice, Image& _image, VkFormat _format, uint32_t _mipLevelCount = 1);
 	static void DestroyImage(VkDevice _vkDevice, Image _image);
 
 	static void WaitFence (VkDevice _vkDevice, uint32_t _fenceCount, VkFence* _fences, VkBool32 _waitAll, uint64_t _timeout);
@@ -273,7 +447,28 @@ namespace VkU
 	static void WaitResetFence(VkDevice _vkDevice, uint32_t _fenceCount, VkFence* _fences, VkBool32 _waitAll, uint64_t _timeout);
 
 	static void LoadShader(const char* _filename, size_t& _fileSize, char** _buffer);
+	static MappedFile MapFile(const char* _filename);
+	static void UnmapFile(MappedFile& _mappedFile);
+	static uint64_t HashData(const uint8_t* _data, uint64_t _size);
+	// Fails when the cache is missing, damaged, of another version or made from other content or post process steps.
+	static bool ReadMeshCache(const char* _filename, uint64_t _sourceHash, uint32_t _postProcessSteps, Meshes& _meshes);
+	static void WriteMeshCache(const char* _filename, uint64_t _sourceHash, uint32_t _postProcessSteps, const Meshes& _meshes);
+	// Reads the model's mesh cache when it is valid, imports it through assimp and rewrites the cache otherwise.
 	static void LoadModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _aiPostProcessSteps);
+	static void ImportModel(const char* _filename, Meshes& _meshes, aiPostProcessSteps _aiPostProcessSteps);
+	// Levels down to 1x1, each one half the size of the previous one, rounded down.
+	static uint32_t GetMipLevelCount(uint32_t _width, uint32_t _height);
+	static VkExtent2D GetMipLevelExtent(uint32_t _width, uint32_t _height, uint32_t _mipLevel);
+	// Offset of _mipLevel in a mip chain, the offset of level mipLevelCount is the chain's size. Every level is tightly
+	// packed and starts at a multiple of 4 texels, as the buffer offsets of image copies require.
+	static VkDeviceSize GetMipLevelOffset(uint32_t _width, uint32_t _height, uint8_t _texelSize, uint32_t _mipLevel);
+	// 2x2 box filter of a level with 3 or 4 one byte channels into the next level, 4 byte texels take an SSE2 path.
+	static void DownsampleBox(const uint8_t* _source, uint32_t _width, uint32_t _height, uint8_t _texelSize, uint8_t* _destination);
+	// Replaces the single level data of _image by its full mip chain.
+	static void GenerateMipChain(ImageData& _image);
+	// Expands TGA run length packets into _pixelCount pixels. Fails when _source ends early or a packet overruns _destination.
+	static bool DecodeRLE(const uint8_t* _source, uint64_t _sourceSize, uint8_t _pixelSize, uint64_t _pixelCount, uint8_t* _destination);
+	// Uncompressed or run length encoded true color TGA, 24 or 32 bits per pixel. Rows are returned top to bottom.
 	static void LoadImageTGA(const char* _filename, uint32_t& _width, uint32_t& _height, uint8_t& _channelCount, uint8_t& _bitsPerChannel, void*& _data);
 
 }
@@ -290,6 +485,12 @@ class Renderer
 	VkCommandPool commandPool;
 	VkCommandBuffer setupCommandBuffer;
 	VkFence setupFence;
+	VkU::TransferBatch transferBatch;
+	WorkerPool workerPool;
+	uint32_t workerThreadCount = WorkerPool::GetDefaultThreadCount();
+	VkU::MEMORY_TOPOLOGY memoryTopology;
+	VkMemoryPropertyFlags hostWriteMemoryPropertyFlags;	// for resources the host writes and the device reads
+	bool directUpload = true;	// write geometry in place when the topology allows it
 	VkRenderPass renderPass;
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSet descriptorSet;
@@ -304,22 +505,34 @@ class Renderer
 
 	// load
 	glm::mat4 viewProjection[2];
-	VkU::Buffer viewProjectionBuffer;
-	VkU::Buffer viewProjectionStagingBuffer;
+
+	// Host visible, one slot per swapchain image holding viewProjection and the point lights.
+	// Render writes the slot of its image and binds it with dynamic offsets.
+	VkU::Buffer uniformRing;
+	VkDeviceSize uniformRingSlotSize;
+	VkDeviceSize viewProjectionOffset;
+	VkDeviceSize pointLightsOffset;
+
+	// Host visible storage buffer, one slot of maxGpuModelMatrixCount matrices per swapchain image. When AddModel
+	// outgrows it Render replaces it and the descriptor set, the old ones are retired to the image being rendered
+	// and destroyed once its fence was waited on again.
+	VkU::Buffer modelMatricesRing;
+	VkDeviceSize modelMatricesSlotSize;
+	uint32_t modelCount;
+	std::vector<std::vector<VkU::Buffer>> retiredBuffers;
+	std::vector<std::vector<VkDescriptorSet>> retiredDescriptorSets;
 
 	uint32_t maxGpuModelMatrixCount;
 	uint32_t maxGpuPointLightCount;
 
-	std::vector<glm::mat4> modelMatrices;
-	VkU::Buffer modelMatricesBuffer;
-	VkU::Buffer modelMatricesStagingBuffer;
+	DirtyArray<glm::mat4> modelMatrices;
 
-	std::vector<VkU::PointLight> pointLights;
-	VkU::Buffer pointLightsBuffer;
-	VkU::Buffer pointLightsStagingBuffer;
+	DirtyArray<VkU::PointLight> pointLights;
 
-	VkU::Buffer vertexBuffer;
-	VkU::Buffer indexBuffer;
+	// Every model loaded is a mesh in the geometry buffer, modelMeshes holds the mesh each model is drawn with.
+	VkU::GeometryBuffer geometryBuffer;
+	std::vector<VkU::Mesh> meshes;
+	std::vector<uint32_t> modelMeshes;
 	std::vector<VkU::Image> imageBuffers;
 
 	std::vector<VkU::ShaderModule>	shaderModules;
@@ -349,9 +562,24 @@ class Renderer
 	// render
 	uint32_t swapchainImageIndex;
 
-	double lastTime = 0.0f;
-	uint64_t frameCount = 0;
-	uint64_t sumFPS = 0;
+	std::vector<VkU::FrameQueries> frameQueries;
+	VkBool32 timestampsSupported;
+	VkBool32 pipelineStatisticsSupported;
+	uint64_t timestampMask;
+	VkU::GpuStatistics gpuStatistics = {};
+
+	FrameStatistics frameStatistics;
+	double lastTime = 0.0;
+	double lastTitleTime = 0.0;
+
+	void CreateModelMatricesRing();
+	void GrowModelMatrices();
+
+	// Queues one import job per model on _workerPool, each with its own importer. _meshes is filled once the pool was waited on.
+	// Without _meshCache every model goes through assimp and no cache is read or written.
+	static void ImportModels(WorkerPool& _workerPool, const std::vector<const char*>& _modelNames, std::vector<VkU::Meshes>& _meshes, bool _meshCache = true);
+	// Queues one decode job per image on _workerPool. _images is filled once the pool was waited on.
+	static void DecodeImages(WorkerPool& _workerPool, const std::vector<const char*>& _imageNames, std::vector<VkU::ImageData>& _images);
 
 public:
 	glm::mat4* GetView()
@@ -362,8 +590,61 @@ public:
 	{
 		return &viewProjection[1];
 	}
-
-	void Init();
+	// Validation message counters, nullptr when the debug report callback is not compiled in.
+	DebugReportSink* GetDebugReportSink();
+	// Results of the newest frame whose queries were read back, a few frames behind Render.
+	VkU::GpuStatistics GetGpuStatistics()
+	{
+		return gpuStatistics;
+	}
+	FrameStatistics* GetFrameStatistics()
+	{
+		return &frameStatistics;
+	}
+	// Call before Init. Disabled, geometry is staged and copied even when the device local memory is host visible.
+	void SetDirectUpload(bool _directUpload)
+	{
+		directUpload = _directUpload;
+	}
+	VkU::MEMORY_TOPOLOGY GetMemoryTopology()
+	{
+		return memoryTopology;
+	}
+	uint64_t GetTransferCopyCount()
+	{
+		return transferBatch.copyCount;
+	}
+	// _mesh indexes the model names given to Load. The storage behind the matrices doubles when full. Returns the model's index.
+	uint32_t AddModel(glm::mat4 _modelMatrix, uint32_t _mesh = 0);
+	void SetModelMatrix(uint32_t _index, glm::mat4 _modelMatrix)
+	{
+		modelMatrices.Modify(_index) = _modelMatrix;
+	}
+	uint32_t GetModelCount()
+	{
+		return modelCount;
+	}
+	uint32_t GetMeshCount()
+	{
+		return (uint32_t)meshes.size();
+	}
+	// Call before Init. The threads Load imports models with, besides the calling thread.
+	void SetWorkerThreadCount(uint32_t _workerThreadCount)
+	{
+		workerThreadCount = _workerThreadCount;
+	}
+	// Imports _modelNames the way Load does, with _threadCount worker threads, and returns the wall-clock seconds. Needs no Init.
+	// Without _meshCache the mesh caches are bypassed and every run times the assimp import.
+	static double MeasureModelImport(const std::vector<const char*>& _modelNames, uint32_t _threadCount, bool _meshCache);
+	// Decodes the TGA _filename _runCount times and returns the best wall-clock seconds, _decodedSize is the size of the texels.
+	static double MeasureImageDecode(const char* _filename, uint32_t _runCount, uint64_t& _decodedSize);
+	// Creates and destroys _resourceCount buffers and images per round through the VkU helpers and validates the memory pool after every step.
+	bool TestMemoryPool(uint32_t _resourceCount, MemoryPool::Statistics& _peak);
+	// Generates mip chains of a few odd sized images, checks them against a scalar box filter, uploads them and compares every level read back from the device.
+	bool TestMipmaps();
+
+	// _headless keeps the window hidden, the swapchain still presents to it.
+	void Init(bool _headless = false);
 
 	struct ShaderProperties
 	{
@@ -13,9 +13,9 @@ layout(binding = 0) uniform ViewProjection
 	mat4 view;
 	mat4 projection;
 } vp;
-layout(binding = 1) uniform ModelMatrices
+layout(binding = 1) readonly buffer ModelMatrices
 {
-	mat4 matrices[1];
+	mat4 matrices[];
 } modelMatrices;
 
 layout(location = 0) in vec3 vertexPosition_modelspace;
@@ -2,6 +2,8 @@
 #define TIMER_H
 
 #include <chrono>
+#include <thread>
+#include <intrin.h>
 
 typedef std::chrono::time_point<std::chrono::steady_clock> Clock;
 
@@ -17,6 +19,16 @@ public:
 		RESOLUTION_MICROSECONDS,
 		RESOLUTION_NANOSECONDS
 	};
+	enum MODE
+	{
+		MODE_ACCUMULATE,	// adds every elapsed interval to a double
+		MODE_INTEGER,		// integer nanosecond base, elapsed time from a single clock read
+	};
+	enum SOURCE
+	{
+		SOURCE_CLOCK,	// high_resolution_clock
+		SOURCE_TSC,		// calibrated rdtsc, falls back to SOURCE_CLOCK without an invariant TSC
+	};
 
 	void SetResolution(RESOLUTION _newResolution)
 	{
@@ -25,37 +37,71 @@ public:
 		case Timer::RESOLUTION_HOURS:
 			timeResolution = ResolutionHours;
 			resolutionMultiplier = 3600.0;
+			resolutionNanoseconds = 3600000000000LL;
 			break;
 		case Timer::RESOLUTION_MINUTES:
 			timeResolution = ResolutionMinutes;
 			resolutionMultiplier = 60.0;
+			resolutionNanoseconds = 60000000000LL;
 			break;
 		case Timer::RESOLUTION_SECONDS:
 			timeResolution = ResolutionSeconds;
 			resolutionMultiplier = 1.0;
+			resolutionNanoseconds = 1000000000LL;
 			break;
 		case Timer::RESOLUTION_MILLISECONDS:
 			timeResolution = ResolutionMilliseconds;
 			resolutionMultiplier = 0.001;
+			resolutionNanoseconds = 1000000LL;
 			break;
 		case Timer::RESOLUTION_MICROSECONDS:
 			timeResolution = ResolutionMicroseconds;
 			resolutionMultiplier = 0.000001;
+			resolutionNanoseconds = 1000LL;
 			break;
 		case Timer::RESOLUTION_NANOSECONDS:
 			timeResolution = ResolutionNanoseconds;
 			resolutionMultiplier = 0.000000001;
+			resolutionNanoseconds = 1LL;
 			break;
 		}
 	}
 
+	// Keeps the current time, switching source restarts the interval being measured.
+	void SetMode(MODE _mode, SOURCE _source = SOURCE_CLOCK)
+	{
+		double currentTime = GetTime();
+
+		mode = _mode;
+		source = _source;
+		if (source == SOURCE_TSC && GetTscFrequency() == 0)
+			source = SOURCE_CLOCK;
+
+		SetTime(currentTime);
+	}
+	MODE GetMode()
+	{
+		return mode;
+	}
+	SOURCE GetSource()
+	{
+		return source;
+	}
+
 	void Play()
 	{
+		if (mode == MODE_INTEGER && paused == false)
+			baseNanoseconds += TicksToNanoseconds(ReadTicks() - startTicks);
+
 		paused = false;
 		clock = std::chrono::high_resolution_clock::now();
+		startTicks = ReadTicks();
 	}
 	void Pause()
 	{
+		if (mode == MODE_INTEGER && paused == false)
+			baseNanoseconds += TicksToNanoseconds(ReadTicks() - startTicks);
+
 		UpdateTime();
 		paused = true;
 	}
@@ -63,10 +109,13 @@ public:
 	{
 		time = 0.0;
 		clock = std::chrono::high_resolution_clock::now();
+
+		baseNanoseconds = 0;
+		startTicks = ReadTicks();
 	}
 	void UpdateTime()
 	{
-		if (paused == false)
+		if (paused == false && mode == MODE_ACCUMULATE)
 		{
 			long long clockTime = timeResolution(clock);
 			time += clockTime * resolutionMultiplier;
@@ -77,18 +126,52 @@ public:
 	}
 	double GetTime()
 	{
+		if (mode == MODE_INTEGER)
+		{
+			long long nanoseconds = GetNanoseconds();
+			return (double)(nanoseconds / 1000000000LL) + (nanoseconds % 1000000000LL) * 0.000000001;
+		}
+
 		UpdateTime();
 		return time;
 	}
+	// Integer time truncated to the resolution, exact in MODE_INTEGER.
+	long long GetNanoseconds()
+	{
+		if (mode == MODE_ACCUMULATE)
+			return (long long)(GetTime() * 1000000000.0);
+
+		long long nanoseconds = baseNanoseconds;
+		if (paused == false)
+			nanoseconds += TicksToNanoseconds(ReadTicks() - startTicks);
+
+		return nanoseconds - nanoseconds % resolutionNanoseconds;
+	}
 	void SetTime(double _newTime)
 	{
 		time = _newTime;
+
+		baseNanoseconds = (long long)(_newTime * 1000000000.0 + 0.5);
+		startTicks = ReadTicks();
 	}
 	bool IsPaused()
 	{
 		return paused;
 	}
 
+	// Nanoseconds on the clock every Timer reads, for code that wants raw timestamps.
+	static inline long long GetTimestamp()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	// TSC ticks per second measured against high_resolution_clock once, 0 without an invariant TSC.
+	static long long GetTscFrequency()
+	{
+		static long long tscFrequency = CalibrateTsc();
+		return tscFrequency;
+	}
+
 private:
 	static inline long long ResolutionHours(Clock _clock)
 	{
@@ -115,12 +198,54 @@ private:
 		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - _clock).count();
 	}
 
+	static long long CalibrateTsc()
+	{
+		int cpuInfo[4];
+		__cpuid(cpuInfo, 0x80000000);
+		if ((unsigned int)cpuInfo[0] < 0x80000007)
+			return 0;
+
+		// invariant TSC: constant rate in every P-, C- and T-state
+		__cpuid(cpuInfo, 0x80000007);
+		if ((cpuInfo[3] & (1 << 8)) == 0)
+			return 0;
+
+		long long clockStart = GetTimestamp();
+		unsigned long long tscStart = __rdtsc();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		long long clockEnd = GetTimestamp();
+		unsigned long long tscEnd = __rdtsc();
+
+		return (long long)((tscEnd - tscStart) * 1000000000.0 / (clockEnd - clockStart) + 0.5);
+	}
+	inline long long ReadTicks()
+	{
+		if (source == SOURCE_TSC)
+			return (long long)__rdtsc();
+		return GetTimestamp();
+	}
+	// Split in whole seconds and remainder so long sessions neither overflow nor round.
+	inline long long TicksToNanoseconds(long long _ticks)
+	{
+		if (source == SOURCE_CLOCK)
+			return _ticks;
+
+		long long frequency = GetTscFrequency();
+		return _ticks / frequency * 1000000000LL + _ticks % frequency * 1000000000LL / frequency;
+	}
+
 	Clock clock;
 	long long(*timeResolution)(Clock _clock) = ResolutionMilliseconds;
 	double resolutionMultiplier = 0.001;
+	long long resolutionNanoseconds = 1000000;
 
 	double time = 0.0;
 
+	MODE mode = MODE_ACCUMULATE;
+	SOURCE source = SOURCE_CLOCK;
+	long long baseNanoseconds = 0;
+	long long startTicks = 0;
+
 	bool paused = true;
 };
 
@@ -0,0 +1,114 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads running submitted jobs in submission order. Wait blocks until
+// every job submitted so far has finished, the waiting thread runs queued jobs itself
+// meanwhile, so a pool without threads still works, serially on the caller.
+class WorkerPool
+{
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable jobQueued;
+	std::condition_variable jobsFinished;
+	std::deque<std::function<void()>> jobs;
+	uint32_t unfinishedJobCount = 0;	// queued or running
+	bool stopping = false;
+
+	// Runs one queued job, _lock is held on entry and on return.
+	void RunJob(std::unique_lock<std::mutex>& _lock)
+	{
+		std::function<void()> job = std::move(jobs.front());
+		jobs.pop_front();
+
+		_lock.unlock();
+		job();
+		_lock.lock();
+
+		if (--unfinishedJobCount == 0)
+			jobsFinished.notify_all();
+	}
+	void WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			jobQueued.wait(lock, [this]() { return stopping || jobs.empty() == false; });
+			if (jobs.empty())
+				return;
+
+			RunJob(lock);
+		}
+	}
+
+public:
+	~WorkerPool()
+	{
+		ShutDown();
+	}
+
+	// One thread per hardware thread but the caller's, which helps in Wait.
+	static uint32_t GetDefaultThreadCount()
+	{
+		uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+		return hardwareThreadCount > 1 ? hardwareThreadCount - 1 : 0;
+	}
+
+	void Init(uint32_t _threadCount)
+	{
+		stopping = false;
+		for (uint32_t i = 0; i != _threadCount; ++i)
+			workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+	}
+	// Finishes the queued jobs first.
+	void ShutDown()
+	{
+		Wait();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobQueued.notify_all();
+
+		for (size_t i = 0; i != workers.size(); ++i)
+			workers[i].join();
+		workers.clear();
+	}
+
+	void Submit(std::function<void()> _job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(_job));
+			++unfinishedJobCount;
+		}
+		jobQueued.notify_one();
+	}
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (unfinishedJobCount != 0)
+		{
+			if (jobs.empty() == false)
+				RunJob(lock);
+			else
+				jobsFinished.wait(lock, [this]() { return unfinishedJobCount == 0 || jobs.empty() == false; });
+		}
+	}
+
+	uint32_t GetThreadCount()
+	{
+		return (uint32_t)workers.size();
+	}
+};
+
+#endif
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <Windows.h>
 
+#define ALLOCATION_COUNTER_OPERATORS
+#include "AllocationCounter.h"
 #include "Timer.h"
 #include "Engine.h"
 #include "Renderer.h"
@@ -90,6 +92,489 @@ double deltaTime = 0.0f;
 
 #define SPAWN_RATE 1.0
 
+//#define BENCHMARK_LOGGER
+
+#ifdef BENCHMARK_LOGGER
+// Logs the same line VK_CHECK_RESULT produces with each logger mode and prints messages per second.
+void BenchmarkLogger(uint32_t _messageCount)
+{
+	const char* modeNames[] = { "MODE_SYNC", "MODE_ASYNC" };
+	Logger::MODE modes[] = { Logger::MODE_SYNC, Logger::MODE_ASYNC };
+
+	for (size_t m = 0; m != sizeof(modes) / sizeof(Logger::MODE); ++m)
+	{
+		Logger benchmarkLogger;
+		benchmarkLogger.Start("_LoggerBenchmark.txt", modes[m]);
+
+		Timer benchmarkTimer;
+		benchmarkTimer.SetResolution(Timer::RESOLUTION_NANOSECONDS);
+		benchmarkTimer.Play();
+
+		for (uint32_t i = 0; i != _messageCount; ++i)
+			benchmarkLogger << "Result: " << 0 << "	Value: " << (void*)&benchmarkLogger << "	Time: " << benchmarkTimer.GetTime() << "	Call: " << "vkQueueSubmit" << '\n';
+
+		double logTime = benchmarkTimer.GetTime();
+		benchmarkLogger.Close();
+		double totalTime = benchmarkTimer.GetTime();
+
+		std::cerr << modeNames[m] << ": " << _messageCount / logTime << " messages/s on the calling thread, " << _messageCount / totalTime << " messages/s including the final flush\n";
+	}
+}
+#endif
+
+//#define BENCHMARK_TIMER
+
+#ifdef BENCHMARK_TIMER
+static const char* timerModeNames[] = { "MODE_ACCUMULATE", "MODE_INTEGER SOURCE_CLOCK", "MODE_INTEGER SOURCE_TSC" };
+static Timer::MODE timerModes[] = { Timer::MODE_ACCUMULATE, Timer::MODE_INTEGER, Timer::MODE_INTEGER };
+static Timer::SOURCE timerSources[] = { Timer::SOURCE_CLOCK, Timer::SOURCE_CLOCK, Timer::SOURCE_TSC };
+
+// Prints the cost of one GetTime call for each timer mode.
+void BenchmarkTimer(uint32_t _callCount)
+{
+	for (size_t m = 0; m != sizeof(timerModes) / sizeof(Timer::MODE); ++m)
+	{
+		Timer benchmarkTimer;
+		benchmarkTimer.SetResolution(Timer::RESOLUTION_NANOSECONDS);
+		benchmarkTimer.SetMode(timerModes[m], timerSources[m]);
+		benchmarkTimer.Play();
+
+		double sum = 0.0;
+		long long start = Timer::GetTimestamp();
+		for (uint32_t i = 0; i != _callCount; ++i)
+			sum += benchmarkTimer.GetTime();
+		long long end = Timer::GetTimestamp();
+
+		std::cerr << timerModeNames[m] << (benchmarkTimer.GetSource() != timerSources[m] ? " (no invariant TSC, clock used)" : "") << ": " << (end - start) / (double)_callCount << " ns per GetTime (" << sum << ")\n";
+	}
+}
+
+// Polls every timer mode like the frame loop does for _seconds and prints how far each one is from a single clock difference.
+void TestTimerDrift(double _seconds)
+{
+	const size_t timerCount = sizeof(timerModes) / sizeof(Timer::MODE);
+	Timer timers[timerCount];
+	for (size_t m = 0; m != timerCount; ++m)
+	{
+		timers[m].SetResolution(Timer::RESOLUTION_NANOSECONDS);
+		timers[m].SetMode(timerModes[m], timerSources[m]);
+	}
+
+	for (size_t m = 0; m != timerCount; ++m)
+		timers[m].Play();
+	long long start = Timer::GetTimestamp();
+
+	long long duration = (long long)(_seconds * 1000000000.0);
+	while (Timer::GetTimestamp() - start < duration)
+	{
+		for (size_t m = 0; m != timerCount; ++m)
+			timers[m].GetTime();
+	}
+
+	double times[timerCount];
+	for (size_t m = 0; m != timerCount; ++m)
+		times[m] = timers[m].GetTime();
+	double reference = (Timer::GetTimestamp() - start) * 0.000000001;
+
+	for (size_t m = 0; m != timerCount; ++m)
+		std::cerr << timerModeNames[m] << ": " << (times[m] - reference) * 1000000.0 << " us drift after " << reference << " s\n";
+}
+#endif
+
+//#define BENCHMARK_STARTUP
+
+#ifdef BENCHMARK_STARTUP
+#define BENCHMARK_STARTUP_ARGUMENT "--startup-run"
+
+// Runs the engine headless up to the end of its first frame and appends the startup time to _StartupBenchmark.csv.
+double RunStartup(const char* _process, uint32_t _run)
+{
+	Engine engine;
+	engine.Init(true);
+	engine.Loop(1);
+	engine.ShutDown();
+
+	FILE* file = fopen("_StartupBenchmark.csv", "a");
+	if (file != NULL)
+	{
+		fprintf(file, "%s,%u,%.6f\n", _process, _run, engine.startupTime);
+		fclose(file);
+	}
+
+	return engine.startupTime;
+}
+
+// The startup time a spawned run appended to _StartupBenchmark.csv, negative when it wrote none.
+double ReadStartupTime(const char* _process, uint32_t _run)
+{
+	double startupTime = -1.0;
+
+	FILE* file = fopen("_StartupBenchmark.csv", "r");
+	if (file == NULL)
+		return startupTime;
+
+	char process[16];
+	uint32_t run;
+	double seconds;
+	char line[128];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, "%15[^,],%u,%lf", process, &run, &seconds) == 3 && strcmp(process, _process) == 0 && run == _run)
+			startupTime = seconds;
+	}
+	fclose(file);
+
+	return startupTime;
+}
+
+// Cold runs start a fresh process each, so the driver, loader and pipeline state are set up from nothing;
+// warm runs repeat the startup inside this process. The OS file cache is warm for both after the first run.
+// Both measure Init to the end of the first frame, process creation and teardown are not part of it.
+// Returns true when this process is one of the spawned cold runs and should exit.
+bool BenchmarkStartup(int _argc, char** _argv, uint32_t _runCount)
+{
+	if (_argc == 3 && strcmp(_argv[1], BENCHMARK_STARTUP_ARGUMENT) == 0)
+	{
+		RunStartup("cold", (uint32_t)atoi(_argv[2]));
+		return true;
+	}
+
+	FILE* file = fopen("_StartupBenchmark.csv", "w");
+	if (file != NULL)
+	{
+		fprintf(file, "process,run,seconds\n");
+		fclose(file);
+	}
+
+	double coldSum = 0.0;
+	uint32_t coldCount = 0;
+	for (uint32_t i = 0; i != _runCount; ++i)
+	{
+		char commandLine[MAX_PATH + 64];
+		snprintf(commandLine, sizeof(commandLine), "\"%s\" %s %u", _argv[0], BENCHMARK_STARTUP_ARGUMENT, i);
+
+		STARTUPINFOA startupInfo = {};
+		startupInfo.cb = sizeof(startupInfo);
+		PROCESS_INFORMATION processInformation = {};
+
+		if (CreateProcessA(NULL, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInformation) == FALSE)
+		{
+			std::cerr << "CreateProcess failed: " << GetLastError() << '\n';
+			break;
+		}
+		WaitForSingleObject(processInformation.hProcess, INFINITE);
+		CloseHandle(processInformation.hThread);
+		CloseHandle(processInformation.hProcess);
+
+		double startupTime = ReadStartupTime("cold", i);
+		if (startupTime < 0.0)
+		{
+			std::cerr << "cold " << i << ": no startup time in _StartupBenchmark.csv\n";
+			break;
+		}
+		coldSum += startupTime;
+		++coldCount;
+
+		std::cerr << "cold " << i << ": " << startupTime << " s to the first frame\n";
+	}
+
+	double warmSum = 0.0;
+	for (uint32_t i = 0; i != _runCount; ++i)
+	{
+		double startupTime = RunStartup("warm", i);
+		warmSum += startupTime;
+
+		std::cerr << "warm " << i << ": " << startupTime << " s to the first frame\n";
+	}
+
+	std::cerr << "cold average: " << (coldCount != 0 ? coldSum / coldCount : 0.0) << " s, warm average: " << warmSum / _runCount << " s to the first frame, per run timings in _StartupBenchmark.csv\n";
+	return true;
+}
+#endif
+
+// TEST_ZERO_ALLOCATION is toggled in AllocationCounter.h
+
+#ifdef TEST_ZERO_ALLOCATION
+// Runs the engine headless for _frameCount frames and fails if any frame after the warmup allocates.
+bool TestZeroAllocation(uint64_t _warmupFrames, uint64_t _frameCount)
+{
+	AllocationCounter::Get().StartTest(_warmupFrames);
+
+	Engine engine;
+	engine.Init(true);
+	engine.Loop(_frameCount);
+	engine.ShutDown();
+
+	bool passed = AllocationCounter::Get().Passed();
+	std::cerr << (passed ? "Zero allocation test passed" : "Zero allocation test failed, call sites in _AllocationReport.txt") << '\n';
+
+	return passed;
+}
+#endif
+
+//#define TEST_MEMORY_POOL
+
+#ifdef TEST_MEMORY_POOL
+// Stresses the memory pool with _resourceCount resources per round on the device the renderer picks, point VK_ICD_FILENAMES at lavapipe to run it without a GPU.
+bool TestMemoryPool(uint32_t _resourceCount)
+{
+	Engine engine;
+	engine.Init(true);
+
+	MemoryPool::Statistics peak;
+	bool passed = engine.renderer.TestMemoryPool(_resourceCount, peak);
+
+	engine.ShutDown();
+
+	std::cerr << "Memory pool test " << (passed ? "passed" : "failed") << ": peak of " << peak.allocationCount << " allocations in " << peak.blockCount << " blocks (" << peak.dedicatedBlockCount << " dedicated), " << (peak.usedBytes >> 20) << " of " << (peak.blockBytes >> 20) << " MB used\n";
+
+	return passed;
+}
+#endif
+
+//#define TEST_MIPMAPS
+
+#ifdef TEST_MIPMAPS
+// Checks generated mip chains and what the device holds after uploading them, point VK_ICD_FILENAMES at lavapipe to run it without a GPU.
+bool TestMipmaps()
+{
+	Engine engine;
+	engine.Init(true);
+
+	bool passed = engine.renderer.TestMipmaps();
+
+	engine.ShutDown();
+
+	std::cerr << "Mipmap test " << (passed ? "passed" : "failed") << '\n';
+
+	return passed;
+}
+#endif
+
+//#define BENCHMARK_FRAME_TIME
+
+#ifdef BENCHMARK_FRAME_TIME
+// Runs the engine headless and prints the frame times of the last frames. Compare runs across builds
+// on the same device, a software ICD (VK_ICD_FILENAMES) keeps the GPU out of the CPU side numbers.
+void BenchmarkFrameTime(uint64_t _frameCount)
+{
+	Engine engine;
+	engine.Init(true);
+	engine.Loop(_frameCount);
+
+	FrameStatistics::Summary summary = engine.renderer.GetFrameStatistics()->GetSummary();
+	engine.ShutDown();
+
+	std::cerr << summary.frameCount << " frames, average: " << summary.average * 1000.0 << "ms, p50: " << summary.p50 * 1000.0 << "ms, p95: " << summary.p95 * 1000.0 << "ms, p99: " << summary.p99 * 1000.0 << "ms, max: " << summary.max * 1000.0 << "ms\n";
+}
+#endif
+
+//#define BENCHMARK_MODEL_COUNT
+
+#ifdef BENCHMARK_MODEL_COUNT
+// Runs the engine headless with a growing number of towers on a grid, each its own draw and matrix,
+// and prints the frame time per model count. Frame times growing linearly with the count is the expected scaling.
+void BenchmarkModelCount(uint64_t _frameCount)
+{
+	uint32_t modelCounts[] = { 16, 1024, 4096, 10000, 16384 };
+	for (size_t c = 0; c != sizeof(modelCounts) / sizeof(uint32_t); ++c)
+	{
+		Engine engine;
+		engine.Init(true);
+
+		for (uint32_t i = 0; i != modelCounts[c]; ++i)
+			engine.renderer.AddModel(glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 128) * 4.0f - 256.0f, -5.0f, (float)(i / 128) * 4.0f)));
+
+		engine.Loop(_frameCount);
+
+		FrameStatistics::Summary summary = engine.renderer.GetFrameStatistics()->GetSummary();
+		engine.ShutDown();
+
+		std::cerr << modelCounts[c] << " models, average: " << summary.average * 1000.0 << "ms, p95: " << summary.p95 * 1000.0 << "ms, " << modelCounts[c] / summary.average << " models/s\n";
+	}
+}
+#endif
+
+//#define BENCHMARK_DIRECT_UPLOAD
+
+#ifdef BENCHMARK_DIRECT_UPLOAD
+// Starts the engine headless _runCount times with geometry staged and written in place, and prints the startup
+// time and the transfer copies recorded at load and per frame. Direct upload needs a unified or resizable BAR
+// topology, lavapipe (VK_ICD_FILENAMES) is unified.
+void BenchmarkDirectUpload(uint32_t _runCount, uint64_t _frameCount)
+{
+	const char* modeNames[] = { "staged", "direct" };
+	for (uint32_t m = 0; m != 2; ++m)
+	{
+		double startupSum = 0.0;
+		uint64_t loadCopies = 0;
+		uint64_t frameCopies = 0;
+		bool directUpload = false;
+		for (uint32_t i = 0; i != _runCount; ++i)
+		{
+			Engine engine;
+			engine.renderer.SetDirectUpload(m == 1);
+			engine.Init(true);
+			engine.Loop(1);
+			loadCopies = engine.renderer.GetTransferCopyCount();
+
+			engine.Loop(_frameCount);
+			frameCopies = engine.renderer.GetTransferCopyCount() - loadCopies;
+			directUpload = m == 1 && engine.renderer.GetMemoryTopology() != VkU::MEMORY_TOPOLOGY_DISCRETE;
+			startupSum += engine.startupTime;
+
+			engine.ShutDown();
+		}
+
+		std::cerr << modeNames[m] << (m == 1 && directUpload == false ? " (not supported, staged)" : "") << ": " << startupSum / _runCount * 1000.0 << "ms to the first frame, " << loadCopies << " copies at load, " << (double)frameCopies / _frameCount << " copies per frame\n";
+	}
+}
+#endif
+
+//#define BENCHMARK_MODEL_IMPORT
+//#define BENCHMARK_MESH_CACHE
+
+#if defined(BENCHMARK_MODEL_IMPORT) || defined(BENCHMARK_MESH_CACHE)
+std::vector<std::string> FindModelFilenames()
+{
+	std::vector<std::string> filenames;
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA("Models/*.fbx", &findData);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+			filenames.push_back(std::string("Models/") + findData.cFileName);
+		while (FindNextFileA(find, &findData) != FALSE);
+		FindClose(find);
+	}
+
+	return filenames;
+}
+#endif
+
+#ifdef BENCHMARK_MODEL_IMPORT
+// Imports every Models/*.fbx through assimp, bypassing the mesh caches, with 0 (the calling thread alone) up to
+// the default worker thread count and prints the best of _runCount wall-clock times per count. Needs no Vulkan device.
+void BenchmarkModelImport(uint32_t _runCount)
+{
+	std::vector<std::string> filenames = FindModelFilenames();
+	std::vector<const char*> modelNames;
+	for (size_t i = 0; i != filenames.size(); ++i)
+		modelNames.push_back(filenames[i].c_str());
+
+	double serial = 0.0;
+	for (uint32_t threadCount = 0; threadCount <= WorkerPool::GetDefaultThreadCount(); threadCount = threadCount == 0 ? 1 : threadCount * 2)
+	{
+		double best = 0.0;
+		for (uint32_t r = 0; r != _runCount; ++r)
+		{
+			double seconds = Renderer::MeasureModelImport(modelNames, threadCount, false);
+			if (r == 0 || seconds < best)
+				best = seconds;
+		}
+		if (threadCount == 0)
+			serial = best;
+
+		std::cerr << modelNames.size() << " models, " << threadCount << " worker threads: " << best * 1000.0 << "ms, " << serial / best << "x\n";
+	}
+}
+#endif
+
+//#define BENCHMARK_TGA_DECODE
+
+#ifdef BENCHMARK_TGA_DECODE
+// Writes a run length encoded copy of the uncompressed TGA _filename, decodes both _runCount times
+// and prints the file sizes and the best decode throughput of each in MB of texels per second.
+void BenchmarkTgaDecode(const char* _filename, uint32_t _runCount)
+{
+	std::string rleFilename = std::string(_filename) + ".rle.tga";
+	{
+		FILE* source = fopen(_filename, "rb");
+		if (source == NULL)
+			return;
+		std::vector<uint8_t> file;
+		uint8_t buffer[4096];
+		for (size_t read; (read = fread(buffer, 1, sizeof(buffer), source)) != 0;)
+			file.insert(file.end(), buffer, buffer + read);
+		fclose(source);
+		if (file.size() < 18 || file[2] != 2)
+			return;
+
+		size_t pixelSize = file[16] / 8;
+		size_t pixelCount = (size_t)(file[13] * 256 + file[12]) * (file[15] * 256 + file[14]);
+		const uint8_t* pixels = file.data() + 18 + file[0];
+		if (file.size() < 18 + file[0] + pixelCount * pixelSize)
+			return;
+
+		// runs of up to 128 equal pixels, raw packets of up to 128 pixels in between
+		std::vector<uint8_t> rle(file.begin(), file.begin() + 18 + file[0]);
+		rle[2] = 10;
+		for (size_t i = 0; i != pixelCount;)
+		{
+			size_t run = 1;
+			while (i + run != pixelCount && run != 128 && memcmp(pixels + i * pixelSize, pixels + (i + run) * pixelSize, pixelSize) == 0)
+				++run;
+			if (run > 1)
+			{
+				rle.push_back((uint8_t)(0x80 | (run - 1)));
+				rle.insert(rle.end(), pixels + i * pixelSize, pixels + (i + 1) * pixelSize);
+				i += run;
+				continue;
+			}
+
+			size_t end = i + 1;
+			while (end != pixelCount && end - i != 128 && (end + 1 == pixelCount || memcmp(pixels + end * pixelSize, pixels + (end + 1) * pixelSize, pixelSize) != 0))
+				++end;
+			rle.push_back((uint8_t)(end - i - 1));
+			rle.insert(rle.end(), pixels + i * pixelSize, pixels + end * pixelSize);
+			i = end;
+		}
+
+		FILE* destination = fopen(rleFilename.c_str(), "wb");
+		if (destination == NULL)
+			return;
+		fwrite(rle.data(), 1, rle.size(), destination);
+		fclose(destination);
+
+		std::cerr << _filename << ": " << file.size() << " bytes uncompressed, " << rle.size() << " bytes run length encoded\n";
+	}
+
+	uint64_t decodedSize = 0;
+	double uncompressed = Renderer::MeasureImageDecode(_filename, _runCount, decodedSize);
+	double compressed = Renderer::MeasureImageDecode(rleFilename.c_str(), _runCount, decodedSize);
+	DeleteFileA(rleFilename.c_str());
+
+	std::cerr << "uncompressed: " << decodedSize / uncompressed / 1000000.0 << "MB/s, run length encoded: " << decodedSize / compressed / 1000000.0 << "MB/s\n";
+}
+#endif
+
+#ifdef BENCHMARK_MESH_CACHE
+// Loads every Models/*.fbx on the calling thread alone, once with the mesh caches deleted (assimp import
+// plus cache write) and then _runCount times from the caches, and prints the cold and best cached times.
+void BenchmarkMeshCache(uint32_t _runCount)
+{
+	std::vector<std::string> filenames = FindModelFilenames();
+	std::vector<const char*> modelNames;
+	for (size_t i = 0; i != filenames.size(); ++i)
+	{
+		modelNames.push_back(filenames[i].c_str());
+		DeleteFileA((filenames[i] + MESH_CACHE_EXTENSION).c_str());
+	}
+
+	double cold = Renderer::MeasureModelImport(modelNames, 0, true);
+
+	double cached = 0.0;
+	for (uint32_t r = 0; r != _runCount; ++r)
+	{
+		double seconds = Renderer::MeasureModelImport(modelNames, 0, true);
+		if (r == 0 || seconds < cached)
+			cached = seconds;
+	}
+
+	std::cerr << modelNames.size() << " models, cold: " << cold * 1000.0 << "ms, cached: " << cached * 1000.0 << "ms, " << cold / cached << "x\n";
+}
+#endif
+
 void EnemyMove(void* _data)
 {
 	glm::mat4 newTransform = glm::translate(glm::mat4(), glm::vec3(((Enemy*)_data)->transform[3][0], ((Enemy*)_data)->transform[3][1], ((Enemy*)_data)->transform[3][2]));
@@ -104,11 +589,57 @@ void EnemyMove(void* _data)
 	((Enemy*)_data)->transform = newTransform;
 }
 
-int main()
+int main(int argc, char** argv)
 {
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 	_CrtSetBreakAlloc(-1);
 
+#ifdef BENCHMARK_LOGGER
+	BenchmarkLogger(100000);
+#endif
+#ifdef BENCHMARK_TIMER
+	BenchmarkTimer(10000000);
+	TestTimerDrift(600.0);
+#endif
+#ifdef BENCHMARK_STARTUP
+	if (BenchmarkStartup(argc, argv, 10))
+		return 0;
+#endif
+
+#ifdef TEST_MEMORY_POOL
+	return TestMemoryPool(4096) ? 0 : 1;
+#endif
+#ifdef TEST_MIPMAPS
+	return TestMipmaps() ? 0 : 1;
+#endif
+#ifdef BENCHMARK_FRAME_TIME
+	BenchmarkFrameTime(2000);
+	return 0;
+#endif
+#ifdef BENCHMARK_MODEL_COUNT
+	BenchmarkModelCount(500);
+	return 0;
+#endif
+#ifdef BENCHMARK_MODEL_IMPORT
+	BenchmarkModelImport(5);
+	return 0;
+#endif
+#ifdef BENCHMARK_TGA_DECODE
+	BenchmarkTgaDecode("Images/face.tga", 100);
+	return 0;
+#endif
+#ifdef BENCHMARK_MESH_CACHE
+	BenchmarkMeshCache(5);
+	return 0;
+#endif
+#ifdef BENCHMARK_DIRECT_UPLOAD
+	BenchmarkDirectUpload(10, 500);
+	return 0;
+#endif
+#ifdef TEST_ZERO_ALLOCATION
+	return TestZeroAllocation(ALLOCATION_COUNTER_WARMUP_FRAMES, 1000) ? 0 : 1;
+#endif
+
 	std::cout << "Controls: QWEASDRF.\n";
 
 	//Timer globalTimer;